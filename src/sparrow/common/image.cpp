@@ -1,4 +1,5 @@
 #include "image.h"
+#include <atomic>
 #pragma warning(disable: 4996)
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -8,6 +9,7 @@
 #include "stb_image_write.h"
 #include "stb_log.h"
 #include "util.h"
+#include "thread_pool.h"
 
 namespace wyc
 {
@@ -177,7 +179,7 @@ namespace wyc
 		}
 	}
 
-	bool CImage::generate_mipmap(std::vector<std::shared_ptr<CImage>>& image_chain)
+	bool CImage::generate_mipmap(std::vector<std::shared_ptr<CImage>>& image_chain, CThreadPool *pool)
 	{
 		if (image_chain.empty())
 			return false;
@@ -194,11 +196,36 @@ namespace wyc
 			h >>= 1;
 			auto new_img = std::make_shared<CImage>();
 			new_img->create_empty(w, h);
-			int ret = stbir_resize_uint8(img0->m_data, img0->m_width, img0->m_height, img0->m_pitch,
-				new_img->m_data, new_img->m_width, new_img->m_height, new_img->m_pitch, 4);
+			image_chain.push_back(new_img);
+		}
+		unsigned level_count = unsigned(image_chain.size());
+		if (pool)
+		{
+			std::atomic_bool success(true);
+			pool->parallel_for(level_count - 1, [&image_chain, &img0, &success](unsigned i) {
+				auto &img = image_chain[i + 1];
+				if (1 != stbir_resize_uint8(img0->m_data, img0->m_width, img0->m_height, img0->m_pitch,
+					img->m_data, img->m_width, img->m_height, img->m_pitch, 4))
+					success = false;
+			});
+			if (!success)
+			{
+				image_chain.resize(1);
+				return false;
+			}
+			return true;
+		}
+		for (unsigned i = 1; i < level_count; ++i)
+		{
+			auto &src = image_chain[i - 1];
+			auto &dst = image_chain[i];
+			int ret = stbir_resize_uint8(src->m_data, src->m_width, src->m_height, src->m_pitch,
+				dst->m_data, dst->m_width, dst->m_height, dst->m_pitch, 4);
 			if (ret != 1)
+			{
+				image_chain.resize(i);
 				return false;
-			image_chain.push_back(new_img);
+			}
 		}
 		return true;
 	}
@@ -8,6 +8,7 @@
 
 namespace wyc
 {
+	class CThreadPool;
 	
 	class CImage
 	{
@@ -30,6 +31,10 @@ namespace wyc
 		inline unsigned height() const {
 			return m_height;
 		}
+		// distance between rows in bytes
+		inline unsigned pitch() const {
+			return m_pitch;
+		}
 		inline color4f get_color(int x, int y) const {
 			assert(x < int(m_width) && y < int(m_height));
 			color4f color;
@@ -48,7 +53,8 @@ namespace wyc
 		// create checker board pattern image
 		void create_checkerboard(unsigned size, const color3f &color1, const color3f &color2);
 		// create mipmap chain
-		static bool generate_mipmap(std::vector<std::shared_ptr<CImage>> &image_chain);
+		// if "pool" is provided, levels are resized from level 0 in parallel
+		static bool generate_mipmap(std::vector<std::shared_ptr<CImage>> &image_chain, CThreadPool *pool = nullptr);
 	private:
 		unsigned char* m_data;
 		unsigned m_width;
@@ -9,9 +9,25 @@
 
 // primitive queue size
 #define PRIMITIVE_QUEUE_SIZE 64
+// max vertex count of a clipped triangle
+#define MAX_POLYGON_VERTEX 10
+// inline vertex payload of a queued primitive (in floats), enough for clipped triangles with 16 floats per vertex
+#define PRIMITIVE_PAYLOAD_SIZE (MAX_POLYGON_VERTEX * 16)
 
+// guard band margin (in pixels) beyond each side of the viewport
+// triangles inside the guard band skip polygon clipping, and are scissored by tile and block bounding
+// it's limited by the coordinate range of the rasterizer for large viewports, but the band is never smaller than the viewport
+#define SPW_GUARD_BAND_SIZE 2048
+
+// tile size of CSpwPipeline is chosen at runtime, so that tile-local color & depth fit in L2 cache
+// it's a power of 2 in range [SPW_TILE_MIN, SPW_TILE_MAX], or SPW_TILE_W x SPW_TILE_H if cache size is unknown
 #define SPW_TILE_W 32
 #define SPW_TILE_H 32
+#define SPW_TILE_MIN 16
+#define SPW_TILE_MAX 128
+
+// max probes of anisotropic texture filtering
+#define SPW_MAX_ANISOTROPY 16
 
 #ifdef SPW_USE_DOUBLE
 using spw_float = double;
@@ -0,0 +1,20 @@
+#pragma once
+
+// SIMD kernels of 4x4 tile coverage
+// each kernel is built with its own instruction set and selected at runtime by tile_coverage(),
+// so this header should not pull in any inline code shared with the other translation units
+// e: edge function values at the first pixel of the tile
+// steps: 3x16 edge function offsets of the tile pixels, 64 bytes aligned
+// tail: low bits of the 3 edge functions
+// w: output 3x16 normalized barycentric coordinates, 64 bytes aligned
+// return the coverage mask, bit i is set if pixel i is inside of triangle
+
+namespace wyc
+{
+	typedef unsigned (*TileCoverageKernel) (const int *e, const int *steps, const float *tail, float *w);
+
+	unsigned tile_coverage_sse4(const int *e, const int *steps, const float *tail, float *w);
+	unsigned tile_coverage_avx2(const int *e, const int *steps, const float *tail, float *w);
+	unsigned tile_coverage_avx512(const int *e, const int *steps, const float *tail, float *w);
+
+} // namespace wyc
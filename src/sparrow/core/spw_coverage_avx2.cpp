@@ -0,0 +1,35 @@
+#include "spw_coverage.h"
+#include <immintrin.h>
+
+namespace wyc
+{
+	unsigned tile_coverage_avx2(const int *e, const int *steps, const float *tail, float *w)
+	{
+		const __m256i e0 = _mm256_set1_epi32(e[0]);
+		const __m256i e1 = _mm256_set1_epi32(e[1]);
+		const __m256i e2 = _mm256_set1_epi32(e[2]);
+		const __m256 t0 = _mm256_set1_ps(tail[0]);
+		const __m256 t1 = _mm256_set1_ps(tail[1]);
+		const __m256 t2 = _mm256_set1_ps(tail[2]);
+		const __m256 one = _mm256_set1_ps(1.0f);
+		unsigned outside = 0;
+		for(int i = 0; i < 16; i += 8)
+		{
+			__m256i x0 = _mm256_add_epi32(e0, _mm256_load_si256((const __m256i*)(steps + i)));
+			__m256i x1 = _mm256_add_epi32(e1, _mm256_load_si256((const __m256i*)(steps + 16 + i)));
+			__m256i x2 = _mm256_add_epi32(e2, _mm256_load_si256((const __m256i*)(steps + 32 + i)));
+			// pixel is outside if any edge function is negative
+			__m256i sign = _mm256_or_si256(_mm256_or_si256(x0, x1), x2);
+			outside |= unsigned(_mm256_movemask_ps(_mm256_castsi256_ps(sign))) << i;
+			__m256 w0 = _mm256_add_ps(_mm256_cvtepi32_ps(x0), t0);
+			__m256 w1 = _mm256_add_ps(_mm256_cvtepi32_ps(x1), t1);
+			__m256 w2 = _mm256_add_ps(_mm256_cvtepi32_ps(x2), t2);
+			__m256 inv = _mm256_div_ps(one, _mm256_add_ps(_mm256_add_ps(w0, w1), w2));
+			_mm256_store_ps(w + i, _mm256_mul_ps(w0, inv));
+			_mm256_store_ps(w + 16 + i, _mm256_mul_ps(w1, inv));
+			_mm256_store_ps(w + 32 + i, _mm256_mul_ps(w2, inv));
+		}
+		return ~outside & 0xFFFF;
+	}
+
+} // namespace wyc
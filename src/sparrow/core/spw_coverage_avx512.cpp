@@ -0,0 +1,25 @@
+#include "spw_coverage.h"
+#include <immintrin.h>
+
+namespace wyc
+{
+	unsigned tile_coverage_avx512(const int *e, const int *steps, const float *tail, float *w)
+	{
+		// the whole 4x4 tile fits in one register
+		__m512i x0 = _mm512_add_epi32(_mm512_set1_epi32(e[0]), _mm512_load_si512(steps));
+		__m512i x1 = _mm512_add_epi32(_mm512_set1_epi32(e[1]), _mm512_load_si512(steps + 16));
+		__m512i x2 = _mm512_add_epi32(_mm512_set1_epi32(e[2]), _mm512_load_si512(steps + 32));
+		// pixel is inside if all edge functions are non-negative
+		__m512i sign = _mm512_or_si512(_mm512_or_si512(x0, x1), x2);
+		__mmask16 inside = _mm512_cmpge_epi32_mask(sign, _mm512_setzero_si512());
+		__m512 w0 = _mm512_add_ps(_mm512_cvtepi32_ps(x0), _mm512_set1_ps(tail[0]));
+		__m512 w1 = _mm512_add_ps(_mm512_cvtepi32_ps(x1), _mm512_set1_ps(tail[1]));
+		__m512 w2 = _mm512_add_ps(_mm512_cvtepi32_ps(x2), _mm512_set1_ps(tail[2]));
+		__m512 inv = _mm512_div_ps(_mm512_set1_ps(1.0f), _mm512_add_ps(_mm512_add_ps(w0, w1), w2));
+		_mm512_store_ps(w, _mm512_mul_ps(w0, inv));
+		_mm512_store_ps(w + 16, _mm512_mul_ps(w1, inv));
+		_mm512_store_ps(w + 32, _mm512_mul_ps(w2, inv));
+		return unsigned(inside);
+	}
+
+} // namespace wyc
@@ -0,0 +1,35 @@
+#include "spw_coverage.h"
+#include <smmintrin.h>
+
+namespace wyc
+{
+	unsigned tile_coverage_sse4(const int *e, const int *steps, const float *tail, float *w)
+	{
+		const __m128i e0 = _mm_set1_epi32(e[0]);
+		const __m128i e1 = _mm_set1_epi32(e[1]);
+		const __m128i e2 = _mm_set1_epi32(e[2]);
+		const __m128 t0 = _mm_set1_ps(tail[0]);
+		const __m128 t1 = _mm_set1_ps(tail[1]);
+		const __m128 t2 = _mm_set1_ps(tail[2]);
+		const __m128 one = _mm_set1_ps(1.0f);
+		unsigned outside = 0;
+		for(int i = 0; i < 16; i += 4)
+		{
+			__m128i x0 = _mm_add_epi32(e0, _mm_load_si128((const __m128i*)(steps + i)));
+			__m128i x1 = _mm_add_epi32(e1, _mm_load_si128((const __m128i*)(steps + 16 + i)));
+			__m128i x2 = _mm_add_epi32(e2, _mm_load_si128((const __m128i*)(steps + 32 + i)));
+			// pixel is outside if any edge function is negative
+			__m128i sign = _mm_or_si128(_mm_or_si128(x0, x1), x2);
+			outside |= unsigned(_mm_movemask_ps(_mm_castsi128_ps(sign))) << i;
+			__m128 w0 = _mm_add_ps(_mm_cvtepi32_ps(x0), t0);
+			__m128 w1 = _mm_add_ps(_mm_cvtepi32_ps(x1), t1);
+			__m128 w2 = _mm_add_ps(_mm_cvtepi32_ps(x2), t2);
+			__m128 inv = _mm_div_ps(one, _mm_add_ps(_mm_add_ps(w0, w1), w2));
+			_mm_store_ps(w + i, _mm_mul_ps(w0, inv));
+			_mm_store_ps(w + 16 + i, _mm_mul_ps(w1, inv));
+			_mm_store_ps(w + 32 + i, _mm_mul_ps(w2, inv));
+		}
+		return ~outside & 0xFFFF;
+	}
+
+} // namespace wyc
@@ -1,61 +1,667 @@
-#include <unordered_map>
 #include "spw_pipeline2.h"
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <limits>
+#include "vecmath.h"
+#include "spw_tile.h"
+#include "pixel_format.h"
+#include "metric.h"
 
 namespace wyc
 {
 
+// fragment context of a triangle in block
+struct FragmentContext
+{
+	float *depth;
+	color4f *color;
+	const CMaterial *material;
+	unsigned stride;
+	bool correction;
+	bool derivative;
+	const float *v[3];
+	float inv_w[3];
+	// depth range of triangle
+	float zmin, zmax;
+	BlockDepth *coarse;
+	// samples per pixel, and depth offset of each sample from pixel center
+	unsigned sample_count;
+	float sample_dz[SPW_MSAA_SAMPLES];
+	// interpolated attributes of the tile, in quad order
+	std::vector<float> frag_input;
+	CShaderContext ctx;
+};
+
+// pixel offset of a 2x2 quad in swizzled storage
+static const int ls_offset[4] = { 0, 1, 4, 5 };
+// pixel index of the top-left pixel of each quad in a 4x4 tile
+static const int ls_quad_offset[4] = { 0, 2, 8, 10 };
+
+// mask of the 2x2 quad starting at pixel "beg" of a tile mask
+static inline unsigned quad_mask(unsigned mask, int beg)
+{
+	return ((mask >> beg) & 3) | (((mask >> (beg + 4)) & 3) << 2);
+}
+
+// samples of a multi-sampled tile are in planes of 16 pixels
+// return index of sample s of pixel i in swizzled block storage
+static inline unsigned sample_index(unsigned i, unsigned s, unsigned sample_count)
+{
+	return (i & ~15u) * sample_count + s * 16 + (i & 15);
+}
+
+// interpolate vertex attributes of live pixels, and the pixels used by ddx/ddy
+static void interpolate_fragment_quad(FragmentContext *frag, unsigned live,
+	const float *w0, const float *w1, const float *w2, float *out)
+{
+	unsigned interp_mask = frag->derivative ? (live | 0x7) : live;
+	const float *i0 = frag->v[0], *i1 = frag->v[1], *i2 = frag->v[2];
+	unsigned stride = frag->stride;
+	if(frag->correction)
+	{
+		const float c0 = frag->inv_w[0], c1 = frag->inv_w[1], c2 = frag->inv_w[2];
+		for(int j = 0; j < 4; ++j)
+		{
+			if(!(interp_mask & (1 << j))) {
+				INTERP_SKIPPED(1)
+				continue;
+			}
+			int k = ls_offset[j];
+			float *dst_in = out + stride * j;
+			float a0 = c0 * w0[k], a1 = c1 * w1[k], a2 = c2 * w2[k];
+			float w = 1.0f / (a0 + a1 + a2);
+			a0 *= w;
+			a1 *= w;
+			a2 *= w;
+			for(unsigned i = 0; i < stride; ++i)
+				dst_in[i] = i0[i] * a0 + i1[i] * a1 + i2[i] * a2;
+		}
+	}
+	else
+	{
+		for(int j = 0; j < 4; ++j)
+		{
+			if(!(interp_mask & (1 << j))) {
+				INTERP_SKIPPED(1)
+				continue;
+			}
+			int k = ls_offset[j];
+			float *dst_in = out + stride * j;
+			for(unsigned i = 0; i < stride; ++i)
+				dst_in[i] = i0[i] * w0[k] + i1[i] * w1[k] + i2[i] * w2[k];
+		}
+	}
+}
+
+// depth test a 2x2 quad in swizzled block storage and interpolate fragment input of the quad to "out"
+// return mask of the pixels passing depth test
+// w0/w1/w2: barycentric coordinates of the top-left pixel of the quad in tile coverage
+// depth_pass: triangle is in front of the tile, so depth test can be skipped
+static unsigned setup_fragment_quad(FragmentContext *frag, char *dst, unsigned mask, bool depth_pass,
+	const float *w0, const float *w1, const float *w2, float *out)
+{
+	float *depth = (float*)dst;
+	const float *z0 = frag->v[0] + 2, *z1 = frag->v[1] + 2, *z2 = frag->v[2] + 2;
+	// early depth test
+	vec4f z;
+	unsigned live = 0;
+	for(int i = 0; i < 4; ++i)
+	{
+		int k = ls_offset[i];
+		z[i] = *z0 * w0[k] + *z1 * w1[k] + *z2 * w2[k];
+		if((mask & (1 << i)) && (depth_pass || z[i] < depth[ls_offset[i]]))
+			live |= 1 << i;
+	}
+	if(!live) {
+		INTERP_SKIPPED(4)
+		return 0;
+	}
+	interpolate_fragment_quad(frag, live, w0, w1, w2, out);
+	for(int i = 0; i < 4; ++i)
+	{
+		if(live & (1 << i))
+			depth[ls_offset[i]] = z[i];
+	}
+	return live;
+}
+
+// multi-sampled version of setup_fragment_quad
+// each covered sample is tested against its own depth, while fragment input is interpolated at pixel center
+// sample_mask: covered samples of the quad, sample_live: output samples passing depth test
+// return mask of the pixels with any sample passing depth test
+static unsigned setup_fragment_quad_msaa(FragmentContext *frag, char *dst, const unsigned *sample_mask, bool depth_pass,
+	const float *w0, const float *w1, const float *w2, float *out, unsigned *sample_live)
+{
+	float *depth = (float*)dst;
+	const float *z0 = frag->v[0] + 2, *z1 = frag->v[1] + 2, *z2 = frag->v[2] + 2;
+	unsigned live = 0;
+	for(int s = 0; s < SPW_MSAA_SAMPLES; ++s)
+		sample_live[s] = 0;
+	for(int i = 0; i < 4; ++i)
+	{
+		int k = ls_offset[i];
+		float z = *z0 * w0[k] + *z1 * w1[k] + *z2 * w2[k];
+		for(int s = 0; s < SPW_MSAA_SAMPLES; ++s)
+		{
+			if(!(sample_mask[s] & (1 << i)))
+				continue;
+			float zs = z + frag->sample_dz[s];
+			float &dst_z = depth[s * 16 + k];
+			if(depth_pass || zs < dst_z) {
+				dst_z = zs;
+				sample_live[s] |= 1 << i;
+				live |= 1 << i;
+			}
+		}
+	}
+	if(!live) {
+		INTERP_SKIPPED(4)
+		return 0;
+	}
+	interpolate_fragment_quad(frag, live, w0, w1, w2, out);
+	return live;
+}
+
+// shade a 4x4 tile with one call of the batch fragment shader
+static void shade_fragment_tile(void *data, char *dst, const TileCoverage &coverage)
+{
+	auto *frag = (FragmentContext*)data;
+	unsigned sample_count = frag->sample_count;
+	unsigned tile = unsigned((float*)dst - frag->depth) / (16 * sample_count);
+	bool depth_pass = frag->zmax < frag->coarse->zmin[block_depth_offset(SPW_LOD_MAX) + tile];
+	unsigned stride = frag->stride;
+	float *frag_input = frag->frag_input.data();
+	// live pixels (and samples) in quad order
+	unsigned live = 0;
+	unsigned sample_live[SPW_MSAA_SAMPLES] = { 0 };
+	for(int q = 0; q < 4; ++q)
+	{
+		int beg = ls_quad_offset[q];
+		unsigned mask = quad_mask(coverage.mask, beg);
+		if(!mask)
+			continue;
+		const float *w0 = coverage.w[0] + beg, *w1 = coverage.w[1] + beg, *w2 = coverage.w[2] + beg;
+		float *out = frag_input + stride * 4 * q;
+		if(sample_count > 1) {
+			unsigned quad_sample_mask[SPW_MSAA_SAMPLES], quad_sample_live[SPW_MSAA_SAMPLES];
+			for(int s = 0; s < SPW_MSAA_SAMPLES; ++s)
+				quad_sample_mask[s] = quad_mask(coverage.sample_mask[s], beg);
+			live |= setup_fragment_quad_msaa(frag, dst + beg * sizeof(float), quad_sample_mask, depth_pass,
+				w0, w1, w2, out, quad_sample_live) << (q * 4);
+			for(int s = 0; s < SPW_MSAA_SAMPLES; ++s)
+				sample_live[s] |= quad_sample_live[s] << (q * 4);
+		}
+		else {
+			live |= setup_fragment_quad(frag, dst + beg * sizeof(float), mask, depth_pass, w0, w1, w2, out) << (q * 4);
+		}
+	}
+	if(!live)
+		return;
+	update_block_depth(frag->coarse, tile, (const float*)dst, sample_count);
+	color4f out_color[16];
+	unsigned written = frag->material->fragment_shader_tile(frag_input, stride, live, out_color, &frag->ctx);
+	color4f *color = frag->color + tile * 16 * sample_count;
+	for(int i = 0; i < 16; ++i)
+	{
+		if(!(written & (1 << i)))
+			continue;
+		auto &c = out_color[i];
+		c.r *= c.a;
+		c.g *= c.a;
+		c.b *= c.a;
+		int k = ls_quad_offset[i >> 2] + ls_offset[i & 3];
+		if(sample_count > 1) {
+			// pixel is shaded once, and its color is stored to the samples passing depth test
+			for(int s = 0; s < SPW_MSAA_SAMPLES; ++s)
+			{
+				if(sample_live[s] & (1 << i))
+					color[s * 16 + k] = c;
+			}
+		}
+		else {
+			color[k] = c;
+		}
+	}
+}
+
 CSpwTilePipeline::CSpwTilePipeline()
+	: m_block_col(0)
+	, m_block_row(0)
+	, m_sample_count(1)
+	, m_batch_count(0)
 {
-	
 }
 
 CSpwTilePipeline::~CSpwTilePipeline()
 {
 }
 
+void CSpwTilePipeline::set_render_target(std::shared_ptr<CSpwRenderTarget> rt)
+{
+	// pending batches and clears belong to the old blocks
+	flush();
+	clear_pending_tiles();
+	m_rt = rt;
+	unsigned surfw, surfh;
+	rt->get_size(surfw, surfh);
+	set_viewport({ { 0, 0 },{ int(surfw), int(surfh) } });
+	m_block_col = (surfw + SPW_BLOCK_SIZE - 1) >> SPW_BLOCK_SIZE_BITS;
+	m_block_row = (surfh + SPW_BLOCK_SIZE - 1) >> SPW_BLOCK_SIZE_BITS;
+	m_sample_count = rt->sample_count();
+}
 
-void CSpwTilePipeline::draw(const CMesh *mesh, const CMaterial *material)
+void CSpwTilePipeline::feed(const CMesh *mesh, const CMaterial *material)
 {
-	auto &vb = mesh->vertex_buffer();
-	auto &ib = mesh->index_buffer();
-	
-	unsigned vertex_per_prim;
-	if(mesh->primitive_type() == PRIM_TYPE_TRIANGLE)
+	assert(mesh && material);
+	if(!m_rt || mesh->primitive_type() != PRIM_TYPE_TRIANGLE)
+		return;
+	VertexStream stream;
+	if(!bind_stream(mesh, material, stream))
+		return;
+
+	// split by batch
+	unsigned prim_count = unsigned(stream.indices->size() / 3);
+	if(!prim_count)
+		return;
+	constexpr unsigned max_prim_per_batch = 12000;
+	unsigned vertex_unit = std::max(1, m_num_vertex_unit);
+	unsigned prim_per_batch = std::min((prim_count + vertex_unit - 1) / vertex_unit, max_prim_per_batch);
+	unsigned batch_count = (prim_count + prim_per_batch - 1) / prim_per_batch;
+	// batches are appended after the pending ones
+	unsigned batch_beg = m_batch_count;
+	if(m_batches.size() < batch_beg + batch_count)
+		m_batches.resize(batch_beg + batch_count);
+
+	// vertex stage
+	std::atomic_uint next_batch(0);
+	std::vector<std::future<void>> jobs;
+	for(unsigned i = 0, count = std::min(vertex_unit, batch_count); i < count; ++i)
 	{
-		vertex_per_prim = 3;
+		jobs.push_back(m_thread_pool->submit([this, &stream, &next_batch, batch_beg, batch_count, prim_per_batch, prim_count] {
+			for(unsigned k = next_batch++; k < batch_count; k = next_batch++)
+			{
+				unsigned prim_beg = k * prim_per_batch;
+				unsigned prim_end = std::min(prim_beg + prim_per_batch, prim_count);
+				process_batch(stream, prim_beg, prim_end, m_batches[batch_beg + k]);
+			}
+		}));
 	}
-	else {
-		// unsupported primitive 
+	for(auto &f : jobs)
+		f.wait();
+	m_batch_count += batch_count;
+	if(!m_is_deferred)
+		flush_batches();
+}
+
+void CSpwTilePipeline::flush()
+{
+	if(m_is_deferred)
+		flush_batches();
+}
+
+void CSpwTilePipeline::resolve()
+{
+	clear_pending_tiles();
+	if(m_rt && m_sample_count > 1)
+		m_rt->resolve();
+	else if(m_rt && m_rt->is_swizzled())
+		m_rt->linearize();
+}
+
+void CSpwTilePipeline::clear(const color4f &color, float depth)
+{
+	flush();
+	m_clear_color = color;
+	m_clear_depth = depth;
+	m_clear_tiles.assign(m_block_col * m_block_row, 1);
+}
+
+void CSpwTilePipeline::clear_pending_tiles()
+{
+	if(m_clear_tiles.empty())
+		return;
+	unsigned surfw, surfh;
+	m_rt->get_size(surfw, surfh);
+	int block_count = m_block_col * m_block_row;
+	m_thread_pool->parallel_for(block_count, [this, surfw, surfh](unsigned i) {
+		if(!m_clear_tiles[i])
+			return;
+		int x0 = int(i) % m_block_col * SPW_BLOCK_SIZE, y0 = int(i) / m_block_col * SPW_BLOCK_SIZE;
+		unsigned w = std::min<unsigned>(SPW_BLOCK_SIZE, surfw - x0);
+		unsigned h = std::min<unsigned>(SPW_BLOCK_SIZE, surfh - y0);
+		// render target is stored upside down
+		m_rt->clear_rect(x0, surfh - y0 - h, w, h, m_clear_color, m_clear_depth, m_sample_count > 1);
+	});
+	m_clear_tiles.clear();
+}
+
+void CSpwTilePipeline::flush_batches()
+{
+	if(!m_batch_count)
 		return;
+	// collect non-empty blocks
+	int block_count = m_block_col * m_block_row;
+	std::vector<int> active_blocks;
+	for(int i = 0; i < block_count; ++i)
+	{
+		for(unsigned k = 0; k < m_batch_count; ++k)
+		{
+			if(!m_batches[k].bins[i].empty()) {
+				active_blocks.push_back(i);
+				break;
+			}
+		}
+	}
+
+	// fragment stage
+	unsigned fragment_unit = std::max(1, m_num_fragment_unit);
+	fragment_unit = std::min(fragment_unit, unsigned(active_blocks.size()));
+	while(m_fragment_units.size() < fragment_unit)
+	{
+		auto *unit = new FragmentUnit;
+		unit->storage.reset(new BlockStorage);
+		unit->arena.reserve(64);
+		m_fragment_units.emplace_back(unit);
+	}
+	std::atomic_uint next_block(0);
+	std::vector<std::future<void>> jobs;
+	for(unsigned i = 0; i < fragment_unit; ++i)
+	{
+		FragmentUnit *unit = m_fragment_units[i].get();
+		jobs.push_back(m_thread_pool->submit([this, &next_block, &active_blocks, unit] {
+			for(unsigned k = next_block++; k < active_blocks.size(); k = next_block++)
+			{
+				process_block(active_blocks[k], *unit);
+			}
+		}));
+	}
+	for(auto &f : jobs)
+		f.wait();
+	m_batch_count = 0;
+}
+
+void CSpwTilePipeline::process_batch(const VertexStream &stream, unsigned prim_beg, unsigned prim_end, Batch &batch) const
+{
+	batch.vertices.clear();
+	batch.triangles.clear();
+	batch.indices.clear();
+	batch.material = stream.material;
+	batch.stride = stream.output_stride;
+	size_t block_count = m_block_col * m_block_row;
+	if(batch.bins.size() != block_count)
+		batch.bins.resize(block_count);
+	for(auto &bin : batch.bins)
+		bin.clear();
+
+	unsigned output_stride = stream.output_stride;
+	process_vertex(stream, prim_beg * 3, prim_end * 3, [&batch, output_stride](const std::vector<float> &vertex_out, const std::vector<unsigned> &indices_out) {
+		// copy polygon vertices
+		int base = int(batch.vertices.size());
+		for(auto j : indices_out)
+		{
+			auto beg = &vertex_out[j];
+			batch.vertices.insert(batch.vertices.end(), beg, beg + output_stride);
+		}
+		// collect triangle fan
+		const float *vertices = batch.vertices.data();
+		const vec2f *p0 = (const vec2f*)(vertices + base);
+		for(size_t k = 2; k < indices_out.size(); ++k)
+		{
+			int i1 = base + int((k - 1) * output_stride);
+			int i2 = base + int(k * output_stride);
+			const vec2f *p1 = (const vec2f*)(vertices + i1);
+			const vec2f *p2 = (const vec2f*)(vertices + i2);
+			// clipping may produce degenerated triangle
+			if((p1->x - p0->x) * (p2->y - p0->y) - (p1->y - p0->y) * (p2->x - p0->x) <= 0)
+				continue;
+			batch.indices.push_back({ base, i1, i2 });
+		}
+	});
+
+	// setup triangles in batches
+	unsigned triangle_count = unsigned(batch.indices.size());
+	batch.triangles.resize(triangle_count);
+	const float *vertices = batch.vertices.data();
+	TriangleBatch setup;
+	for(unsigned beg = 0; beg < triangle_count; beg += SPW_SETUP_BATCH)
+	{
+		unsigned count = std::min(triangle_count - beg, unsigned(SPW_SETUP_BATCH));
+		for(unsigned i = 0; i < count; ++i)
+		{
+			const vec3i &tri = batch.indices[beg + i];
+			for(int k = 0; k < 3; ++k)
+			{
+				setup.x[k][i] = vertices[tri[k]];
+				setup.y[k][i] = vertices[tri[k] + 1];
+			}
+		}
+		setup_triangles(&batch.triangles[beg], &setup, count);
+	}
+
+	// bin triangles by bounding box
+	for(unsigned index = 0; index < triangle_count; ++index)
+	{
+		const int16_t *bounding = batch.triangles[index].bounding;
+		int x0 = std::max(bounding[0] >> SPW_BLOCK_SIZE_BITS, 0);
+		int y0 = std::max(bounding[1] >> SPW_BLOCK_SIZE_BITS, 0);
+		int x1 = std::min(bounding[2] >> SPW_BLOCK_SIZE_BITS, m_block_col - 1);
+		int y1 = std::min(bounding[3] >> SPW_BLOCK_SIZE_BITS, m_block_row - 1);
+		for(int y = y0; y <= y1; ++y)
+		{
+			for(int x = x0; x <= x1; ++x)
+			{
+				batch.bins[y * m_block_col + x].push_back(index);
+			}
+		}
+	}
+}
+
+void CSpwTilePipeline::process_block(int block_index, FragmentUnit &unit)
+{
+	int block_x = block_index % m_block_col;
+	int block_y = block_index / m_block_col;
+	BlockStorage *storage = unit.storage.get();
+	BlockArena *arena = &unit.arena;
+	load_block(block_x, block_y, storage);
+
+	RenderTarget rt;
+	rt.storage = (char*)storage->depth;
+	// samples of a pixel are stored as a larger pixel
+	rt.pixel_size = sizeof(float) * m_sample_count;
+	rt.pitch = SPW_BLOCK_SIZE * rt.pixel_size;
+	rt.w = 1;
+	rt.h = 1;
+	rt.x = block_x;
+	rt.y = block_y;
+
+	FragmentContext frag;
+	frag.depth = storage->depth;
+	frag.color = storage->color;
+	frag.material = nullptr;
+	frag.coarse = &storage->coarse;
+	frag.sample_count = m_sample_count;
+	bool multisample = m_sample_count > 1;
+
+	TileQueue full_tiles, partial_tiles;
+	for(unsigned k = 0; k < m_batch_count; ++k)
+	{
+		const Batch &batch = m_batches[k];
+		if(batch.bins[block_index].empty())
+			continue;
+		if(batch.material != frag.material)
+		{
+			// batches may come from different draws
+			frag.material = batch.material;
+			frag.stride = batch.stride;
+			frag.correction = !(batch.material->feature() & MF_NO_PERSPECTIVE_CORRECTION);
+			frag.derivative = (batch.material->feature() & MF_QUAD_DERIVATIVE) != 0;
+			frag.frag_input.resize(batch.stride * 16);
+			frag.ctx.vertex_quad = frag.frag_input.data();
+		}
+		for(auto index : batch.bins[block_index])
+		{
+			const Triangle *prim = &batch.triangles[index];
+			const vec3i &vi = batch.indices[index];
+			for(int i = 0; i < 3; ++i)
+				frag.v[i] = &batch.vertices[vi[i]];
+			frag.zmin = std::min({ frag.v[0][2], frag.v[1][2], frag.v[2][2] });
+			frag.zmax = std::max({ frag.v[0][2], frag.v[1][2], frag.v[2][2] });
+			// triangle is behind the whole block
+			if(frag.zmin >= storage->coarse.zmax[0]) {
+				HIZ_CULLING
+				continue;
+			}
+			if(!scan_block(&rt, prim, arena, &full_tiles, &partial_tiles))
+				continue;
+			for(int i = 0; i < 3; ++i)
+				frag.inv_w[i] = 1.0f / frag.v[i][3];
+			if(multisample) {
+				// depth is linear in viewport space, offset it from pixel center to sample positions
+				const float *v0 = frag.v[0], *v1 = frag.v[1], *v2 = frag.v[2];
+				float x1 = v1[0] - v0[0], y1 = v1[1] - v0[1], z1 = v1[2] - v0[2];
+				float x2 = v2[0] - v0[0], y2 = v2[1] - v0[1], z2 = v2[2] - v0[2];
+				float inv_area = 1.0f / (x1 * y2 - x2 * y1);
+				float dzdx = (z1 * y2 - z2 * y1) * inv_area;
+				float dzdy = (x1 * z2 - x2 * z1) * inv_area;
+				for(int s = 0; s < SPW_MSAA_SAMPLES; ++s)
+					frag.sample_dz[s] = (dzdx * msaa_sample_offset[s][0] + dzdy * msaa_sample_offset[s][1]) * 0.125f;
+			}
+			// render target is a single block, there is at most one block in the queues
+			if(TileBlock *block = partial_tiles.pop()) {
+				rasterize_block(prim, block, false, &shade_fragment_tile, &frag, frag.coarse, frag.zmin, multisample);
+				arena->free(block);
+			}
+			else if(TileBlock *block = full_tiles.pop()) {
+				rasterize_block(prim, block, true, &shade_fragment_tile, &frag, frag.coarse, frag.zmin, multisample);
+				arena->free(block);
+			}
+		}
+	}
+	flush_block(block_x, block_y, storage);
+}
+
+void CSpwTilePipeline::load_block(int block_x, int block_y, BlockStorage *storage)
+{
+	unsigned surfw, surfh;
+	m_rt->get_size(surfw, surfh);
+	int x0 = block_x * SPW_BLOCK_SIZE, y0 = block_y * SPW_BLOCK_SIZE;
+	int w = std::min<int>(SPW_BLOCK_SIZE, surfw - x0);
+	int h = std::min<int>(SPW_BLOCK_SIZE, surfh - y0);
+	unsigned sample_count = m_sample_count;
+	bool multisample = sample_count > 1;
+	bool swizzled = m_rt->is_swizzled();
+	CSurface &color = multisample ? m_rt->get_sample_color_buffer() : (swizzled ? m_rt->get_swizzled_color_buffer() : m_rt->get_color_buffer());
+	CSurface &depth = multisample ? m_rt->get_sample_depth_buffer() : m_rt->get_depth_buffer();
+	if(w < SPW_BLOCK_SIZE || h < SPW_BLOCK_SIZE)
+		// pixels outside of render target are never visible, the lowest depth fails any depth test
+		std::fill(storage->depth, storage->depth + SPW_BLOCK_SIZE * SPW_BLOCK_SIZE * sample_count, std::numeric_limits<float>::lowest());
+	int block_index = block_y * m_block_col + block_x;
+	if(!m_clear_tiles.empty() && m_clear_tiles[block_index]) {
+		// the first draw since clear() fills the block in cache, render target is not read
+		m_clear_tiles[block_index] = 0;
+		std::fill(storage->color, storage->color + SPW_BLOCK_SIZE * SPW_BLOCK_SIZE * sample_count, m_clear_color);
+		if(w == SPW_BLOCK_SIZE && h == SPW_BLOCK_SIZE) {
+			std::fill(storage->depth, storage->depth + SPW_BLOCK_SIZE * SPW_BLOCK_SIZE * sample_count, m_clear_depth);
+		}
+		else {
+			for(int y = 0; y < h; ++y)
+				for(int x = 0; x < w; ++x)
+					for(unsigned s = 0; s < sample_count; ++s)
+						storage->depth[sample_index(swizzle_block_index(x, y), s, sample_count)] = m_clear_depth;
+		}
+		init_block_depth(&storage->coarse, storage->depth, sample_count);
+		return;
+	}
+	// rows are converted from render target format, and scattered to swizzled block storage
+	EPixelFormat format = m_rt->color_format();
+	unsigned count = w * sample_count;
+	color4f line[SPW_BLOCK_SIZE * SPW_MSAA_SAMPLES];
+	float line_depth[SPW_BLOCK_SIZE * SPW_MSAA_SAMPLES];
+	uint32_t packed[SPW_BLOCK_SIZE * SPW_MSAA_SAMPLES * 2];
+	for(int y = 0; y < h; ++y)
+	{
+		// render target is stored upside down
+		int row = surfh - 1 - (y0 + y);
+		if(swizzled) {
+			// swizzled render target is 32bpp without multi-sampling, pixels in a row of 4x4 tile are contiguous
+			const uint32_t *src_color = (const uint32_t*)color.get_buffer();
+			const float *src_depth = (const float*)depth.get_buffer();
+			for(int x = 0; x < w; x += 4)
+			{
+				unsigned src = swizzle_index(x0 + x, row, color.row_length());
+				unsigned n = std::min(4, w - x);
+				memcpy(packed + x, src_color + src, n * sizeof(uint32_t));
+				memcpy(line_depth + x, src_depth + src, n * sizeof(float));
+			}
+			unpack_color(line, packed, count, format);
+		}
+		else {
+			unpack_color(line, color.get(x0 * sample_count, row), count, format);
+			memcpy(line_depth, depth.get<float>(x0 * sample_count, row), count * sizeof(float));
+		}
+		for(int x = 0; x < w; ++x)
+		{
+			unsigned i = swizzle_block_index(x, y);
+			for(unsigned s = 0; s < sample_count; ++s)
+			{
+				unsigned k = sample_index(i, s, sample_count);
+				storage->depth[k] = line_depth[x * sample_count + s];
+				storage->color[k] = line[x * sample_count + s];
+			}
+		}
+	}
+	init_block_depth(&storage->coarse, storage->depth, sample_count);
+}
+
+void CSpwTilePipeline::flush_block(int block_x, int block_y, const BlockStorage *storage)
+{
+	unsigned surfw, surfh;
+	m_rt->get_size(surfw, surfh);
+	int x0 = block_x * SPW_BLOCK_SIZE, y0 = block_y * SPW_BLOCK_SIZE;
+	int w = std::min<int>(SPW_BLOCK_SIZE, surfw - x0);
+	int h = std::min<int>(SPW_BLOCK_SIZE, surfh - y0);
+	unsigned sample_count = m_sample_count;
+	bool multisample = sample_count > 1;
+	bool swizzled = m_rt->is_swizzled();
+	CSurface &color = multisample ? m_rt->get_sample_color_buffer() : (swizzled ? m_rt->get_swizzled_color_buffer() : m_rt->get_color_buffer());
+	CSurface &depth = multisample ? m_rt->get_sample_depth_buffer() : m_rt->get_depth_buffer();
+	// rows are gathered from swizzled block storage, and converted to render target format on the way out
+	EPixelFormat format = m_rt->color_format();
+	unsigned count = w * sample_count;
+	color4f line[SPW_BLOCK_SIZE * SPW_MSAA_SAMPLES];
+	float line_depth[SPW_BLOCK_SIZE * SPW_MSAA_SAMPLES];
+	uint32_t packed[SPW_BLOCK_SIZE * SPW_MSAA_SAMPLES * 2];
+	for(int y = 0; y < h; ++y)
+	{
+		int row = surfh - 1 - (y0 + y);
+		for(int x = 0; x < w; ++x)
+		{
+			unsigned i = swizzle_block_index(x, y);
+			for(unsigned s = 0; s < sample_count; ++s)
+			{
+				unsigned k = sample_index(i, s, sample_count);
+				line_depth[x * sample_count + s] = storage->depth[k];
+				line[x * sample_count + s] = storage->color[k];
+			}
+		}
+		if(swizzled) {
+			pack_color(packed, line, count, format);
+			uint32_t *dst_color = (uint32_t*)color.get_buffer();
+			float *dst_depth = (float*)depth.get_buffer();
+			for(int x = 0; x < w; x += 4)
+			{
+				unsigned dst = swizzle_index(x0 + x, row, color.row_length());
+				unsigned n = std::min(4, w - x);
+				memcpy(dst_color + dst, packed + x, n * sizeof(uint32_t));
+				memcpy(dst_depth + dst, line_depth + x, n * sizeof(float));
+			}
+		}
+		else {
+			pack_color(color.get(x0 * sample_count, row), line, count, format);
+			memcpy(depth.get<float>(x0 * sample_count, row), line_depth, count * sizeof(float));
+		}
 	}
-	
-	unsigned prim_count = ib.size() / vertex_per_prim;
-	unsigned vert_count = prim_count * vertex_per_prim;
-	unsigned max_prim_per_batch = 12000;
-	unsigned prim_per_batch = std::min(prim_count, max_prim_per_batch);
-	
-	auto *index_data = ib.data();
-	auto *vertex_data = vb.get_buffer();
-	int stride = vb.vertex_component();
-	const float *pos_stream = (const float*)vb.attrib_stream(ATTR_POSITION);
-	
-	// split by batch
-	for(unsigned prim_index = 0; prim_index < prim_count; prim_index += prim_per_batch)
-	{
-		// draw primitives
-		for(int i = prim_index; i < prim_per_batch; ++i)
-		{
-			auto i1 = *index_data++;
-			auto i2 = *index_data++;
-			auto i3 = *index_data++;
-			
-			const float *v1 = pos_stream + i1 * stride;
-			const float *v2 = pos_stream + i2 * stride;
-			const float *v3 = pos_stream + i3 * stride;
-			
-			
-		} // loop of primitives
-	} // loop of batch
 }
 
 } // namespace wyc
@@ -1,18 +1,79 @@
 #pragma once
 //#include <enoki/array.h>
+#include <memory>
+#include <vector>
 #include "mesh.h"
 #include "material.h"
+#include "spw_pipeline.h"
+#include "spw_rasterizer.h"
 
 namespace wyc {
 
-class CSpwTilePipeline
+// Sort-middle tile renderer built on the Larrabee rasterizer
+// 1. vertex stage runs in batches, each batch shades, clips and sets up its own triangles
+// 2. triangles are binned into the 64x64 blocks they overlap
+// 3. each block is rasterized by one worker (at flush() in deferred mode), in a cache resident swizzled buffer,
+//    and then flushed to the render target
+class CSpwTilePipeline : public CSpwPipeline
 {
 public:
 	CSpwTilePipeline();
-	~CSpwTilePipeline();
-	virtual void draw(const CMesh *mesh, const CMaterial *material);
-	
+	virtual ~CSpwTilePipeline() override;
+	virtual void set_render_target(std::shared_ptr<CSpwRenderTarget> rt) override;
+	virtual void feed(const CMesh *mesh, const CMaterial *material) override;
+	virtual void flush() override;
+	virtual void resolve() override;
+	virtual void clear(const color4f &color, float depth) override;
+
 protected:
+	// vertex stage output
+	struct Batch
+	{
+		// vertices after clipping and viewport transform
+		std::vector<float> vertices;
+		// setup data of each triangle
+		std::vector<Triangle> triangles;
+		// offset of triangle vertices in vertex buffer
+		std::vector<vec3i> indices;
+		// triangle index list of each block
+		std::vector<std::vector<unsigned>> bins;
+		const CMaterial *material;
+		unsigned stride;
+	};
+
+	// swizzled color & depth of a block
+	// with multi-sampling, each 4x4 tile stores its samples next to each other, in one plane of 16 pixels per sample
+	struct CACHE_LINE_ALIGN BlockStorage
+	{
+		float depth[SPW_BLOCK_SIZE * SPW_BLOCK_SIZE * SPW_MSAA_SAMPLES];
+		color4f color[SPW_BLOCK_SIZE * SPW_BLOCK_SIZE * SPW_MSAA_SAMPLES];
+		// min/max depth of the block and its tiles
+		BlockDepth coarse;
+	};
+
+	// fragment worker context
+	struct FragmentUnit
+	{
+		std::unique_ptr<BlockStorage> storage;
+		BlockArena arena;
+	};
+
+	int m_block_col;
+	int m_block_row;
+	// sample count of render target
+	unsigned m_sample_count;
+	std::vector<Batch> m_batches;
+	// number of batches waiting for rasterization
+	unsigned m_batch_count;
+	std::vector<std::unique_ptr<FragmentUnit>> m_fragment_units;
+
+	// rasterize pending batches
+	void flush_batches();
+	void process_batch(const VertexStream &stream, unsigned prim_beg, unsigned prim_end, Batch &batch) const;
+	void process_block(int block_index, FragmentUnit &unit);
+	void load_block(int block_x, int block_y, BlockStorage *storage);
+	void flush_block(int block_x, int block_y, const BlockStorage *storage);
+	virtual void clear_pending_tiles() override;
 };
 
 } // namespace wyc
@@ -2,9 +2,16 @@
 #include "ImathMatrix.h"
 #include "vecmath.h"
 #include "spw_rasterizer.h"
+#include "spw_coverage.h"
+#include "platform_info.h"
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 #include <vector>
 #include <algorithm>
 #include <cassert>
+#include <cstring>
 
 namespace wyc
 {
@@ -12,6 +19,8 @@ namespace wyc
 	// when individual coordinates are in range [-2^p, 2^p-1], the result of edge function fits inside 2*(p+2) bit signed integer
 	// if we use a 32-bit integer to store edge function, then p=32/2-2=14, so the coordinates should be in range [-16384, 16383]
 	// if we use a 24.8 sub-pixel precision, then p=24/2-2=10, so coordinates should be [-1024, 1024]
+	// to support larger render target, edge function is evaluated in 64-bit down to the block level, each block starts from its exact value,
+	// and values of a block stay in 32-bit unless the block is far away from an edge of a large triangle
 	inline int coordinate_precision(int available_bits)
 	{
 		return available_bits / 2 - 2;
@@ -22,20 +31,37 @@ namespace wyc
 		return (v & (v-1)) == 0;
 	}
 	
+	// reject corner of edge: at right if dx > 0, and at top if dy >= 0
+	// accept corner is at the opposite, so the offset from reject corner to accept corner is -|dx| - |dy|
+	static inline int edge_rc2ac(const vec2i &dv)
+	{
+		return -(std::abs(dv.x) + std::abs(dv.y));
+	}
+
+	// top-left fill rule bias
+	// in a counter-clockwise triangle, a top edge is exactly horizontal and goes left, a left edge goes down
+	static inline int edge_bias(const vec2i &dv)
+	{
+		return (dv.x > 0 || (dv.x == 0 && dv.y < 0)) ? 0 : -1;
+	}
+
+	// reject corner offsets of the children of a node (r, c) = r * dy + c * dx + edge_step_base()
+	static inline int edge_step_base(const vec2i &dv)
+	{
+		return -3 * ((dv.x > 0 ? dv.x : 0) + (dv.y >= 0 ? dv.y : 0));
+	}
+
 	// 1. vertices are in counter-clockwise order
+	// 2. edge j is the edge opposite to vertex j, so its value is the barycentric weight of vertex j
 	void setup_triangle(Triangle *prim, const vec2f *vf0, const vec2f *vf1, const vec2f *vf2)
 	{
 		const vec2i vi[3] = {
-			snap_to_subpixel<SPW_SUB_PIXEL_PRECISION>(*vf1),
 			snap_to_subpixel<SPW_SUB_PIXEL_PRECISION>(*vf2),
 			snap_to_subpixel<SPW_SUB_PIXEL_PRECISION>(*vf0),
+			snap_to_subpixel<SPW_SUB_PIXEL_PRECISION>(*vf1),
 		};
 		
-		vec4i &bounding = prim->bounding;
-		bounding.x = vi[0].x;
-		bounding.y = vi[0].y;
-		bounding.z = bounding.x;
-		bounding.w = bounding.y;
+		vec4i bounding(vi[0].x, vi[0].y, vi[0].x, vi[0].y);
 		for(int i = 1; i < 3; ++i)
 		{
 			int x = vi[i].x;
@@ -49,152 +75,203 @@ namespace wyc
 			if(y > bounding.w)
 				bounding.w = y;
 		}
+		for(int i = 0; i < 4; ++i)
+			prim->bounding[i] = int16_t(bounding[i] >> SPW_SUB_PIXEL_PRECISION);
 		
 		// block size with sub pixel precision
 		constexpr int block_size_hp = SPW_BLOCK_SIZE << SPW_SUB_PIXEL_PRECISION;
-		constexpr int last_shift = SPW_SUB_PIXEL_PRECISION + SPW_TILE_SIZE_BITS;
-		constexpr int last_mask = (1 << last_shift) - 1;
 
 		for(int i1=2, i2=0, j=0; i2 < 3; i1 = i2, i2 += 1, ++j)
 		{
 			auto &vi1 = vi[i1];
 			auto &vi2 = vi[i2];
-			vec2i rc;  // reject corner
-			vec2i ac;  // offset of reject corner to accpet corner
 			vec2i &dv = prim->dxdy[j];
 			dv.setValue(vi1.y - vi2.y, vi2.x - vi1.x);
-			int dx = vi2.x - vi1.x;
-			int dy = vi2.y - vi1.y;
-			if(dx >= 0) {
-				if(dy >= 0) {
-					// point to 1st quadrant
-					// the trivial reject point is at *
-					// * -- o
-					// |    |
-					// o -- o
-					rc.setValue(0, block_size_hp);
-					ac.setValue(dv.x, -dv.y);
-					int r1 = ac.y;
-					int r2 = r1 * 2;
-					int r3 = r1 * 3;
-					int c1 = ac.x;
-					int c2 = c1 * 2;
-					int c3 = c1 * 3;
-					prim->rc_steps[j] = {
-						r3, r3 + c1, r3 + c2, r3 + c3,
-						r2, r2 + c1, r2 + c2, r2 + c3,
-						r1, r1 + c1, r1 + c2, r1 + c3,
-						0, c1, c2, c3,
-					};
-				}
-				else {
-					// point to 4th quadrant
-					// the trivial reject point is at *
-					// o -- *
-					// |    |
-					// o -- o
-					rc.setValue(block_size_hp, block_size_hp);
-					ac.setValue(-dv.x, -dv.y);
-					int r1 = ac.y;
-					int r2 = r1 * 2;
-					int r3 = r1 * 3;
-					int c1 = ac.x;
-					int c2 = c1 * 2;
-					int c3 = c1 * 3;
-					prim->rc_steps[j] = {
-						r3 + c3, r3 + c2, r3 + c1, r3,
-						r2 + c3, r2 + c2, r2 + c1, r2,
-						r1 + c3, r1 + c2, r1 + c1, r1,
-						c3, c2, c1, 0,
-					};
-				}
-			}
-			else {
-				if(dy >= 0) {
-					// point to 2nd quadrand
-					// the trivial reject point is at *
-					// o -- o
-					// |    |
-					// * -- o
-					rc.setValue(0, 0);
-					ac.setValue(dv.x, dv.y);
-					int r1 = ac.y;
-					int r2 = r1 * 2;
-					int r3 = r1 * 3;
-					int c1 = ac.x;
-					int c2 = c1 * 2;
-					int c3 = c1 * 3;
-					prim->rc_steps[j] = {
-						0, c1, c2, c3,
-						r1, r1 + c1, r1 + c2, r1 + c3,
-						r2, r2 + c1, r2 + c2, r2 + c3,
-						r3, r3 + c1, r3 + c2, r3 + c3,
-					};
-				}
-				else {
-					// point to 3rd quadrand
-					// the trivial reject point is at *
-					// o -- o
-					// |    |
-					// o -- *
-					rc.setValue(block_size_hp, 0);
-					ac.setValue(-dv.x, dv.y);
-					int r1 = ac.y;
-					int r2 = r1 * 2;
-					int r3 = r1 * 3;
-					int c1 = ac.x;
-					int c2 = c1 * 2;
-					int c3 = c1 * 3;
-					prim->rc_steps[j] = {
-						c3, c2, c1, 0,
-						r1 + c3, r1 + c2, r1 + c1, r1,
-						r2 + c3, r2 + c2, r2 + c1, r2,
-						r3 + c3, r3 + c2, r3 + c1, r3,
-					};
-				}
-			} // detect edge direction
-			prim->rc2ac[j] = ac.x + ac.y;
+			vec2i rc(dv.x > 0 ? block_size_hp : 0, dv.y >= 0 ? block_size_hp : 0);
 			int64_t v = edge_function_fixed(vi1, vi2, rc);
 			prim->rc_hp[j] = v;
-			int b = is_top_left(vi1, vi2) ? 0 : -1;
-			prim->bias[j] = b;
-			// .8 sub-pixel part with reversed bias
-			prim->tail[j] = float(int((v + b) & 0xFF) - b) / 256;
-//			prim->tail[j] = float((v & 0xFF) - b) / 255;
-			// factor to calculate full precision edge function at pixel center (0.5 sub-pixel precision)
-			prim->center_offset[j] = int(v & last_mask) + (prim->rc2ac[j] << 7) + b;
+			for(int lod = 1; lod <= SPW_LOD_MAX; ++lod)
+				prim->lod_offset[j][lod - 1] = uint8_t(v >> triangle_lod_shift(lod) & SPW_TILE_SIZE_MASK);
 		}
 	}
 	
+	static inline __m128i min_epi32(__m128i a, __m128i b)
+	{
+		__m128i m = _mm_cmpgt_epi32(a, b);
+		return _mm_or_si128(_mm_and_si128(m, b), _mm_andnot_si128(m, a));
+	}
+
+	static inline __m128i max_epi32(__m128i a, __m128i b)
+	{
+		__m128i m = _mm_cmpgt_epi32(a, b);
+		return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b));
+	}
+
+	void setup_triangles(Triangle *prims, const TriangleBatch *batch, unsigned count)
+	{
+		assert(count <= SPW_SETUP_BATCH);
+		// block size with sub pixel precision
+		constexpr int block_size_hp = SPW_BLOCK_SIZE << SPW_SUB_PIXEL_PRECISION;
+		const __m128 scale = _mm_set1_ps(float(1 << SPW_SUB_PIXEL_PRECISION));
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i ones = _mm_set1_epi32(-1);
+		const __m128i block_size = _mm_set1_epi32(block_size_hp);
+		for(unsigned beg = 0; beg < count; beg += 4)
+		{
+			// snap to sub pixel, vertices are in the same order as setup_triangle
+			constexpr int order[3] = { 2, 0, 1 };
+			__m128i x[3], y[3];
+			for(int i = 0; i < 3; ++i)
+			{
+				x[i] = _mm_cvtps_epi32(_mm_mul_ps(_mm_load_ps(batch->x[order[i]] + beg), scale));
+				y[i] = _mm_cvtps_epi32(_mm_mul_ps(_mm_load_ps(batch->y[order[i]] + beg), scale));
+			}
+			alignas(16) int bounding[4][4];
+			_mm_store_si128((__m128i*)bounding[0], _mm_srai_epi32(min_epi32(min_epi32(x[0], x[1]), x[2]), SPW_SUB_PIXEL_PRECISION));
+			_mm_store_si128((__m128i*)bounding[1], _mm_srai_epi32(min_epi32(min_epi32(y[0], y[1]), y[2]), SPW_SUB_PIXEL_PRECISION));
+			_mm_store_si128((__m128i*)bounding[2], _mm_srai_epi32(max_epi32(max_epi32(x[0], x[1]), x[2]), SPW_SUB_PIXEL_PRECISION));
+			_mm_store_si128((__m128i*)bounding[3], _mm_srai_epi32(max_epi32(max_epi32(y[0], y[1]), y[2]), SPW_SUB_PIXEL_PRECISION));
+
+			alignas(16) int dxdy[3][2][4];
+			alignas(16) double rc_hp[3][4];
+			for(int i1 = 2, i2 = 0, j = 0; i2 < 3; i1 = i2, i2 += 1, ++j)
+			{
+				__m128i dx = _mm_sub_epi32(y[i1], y[i2]);
+				__m128i dy = _mm_sub_epi32(x[i2], x[i1]);
+				_mm_store_si128((__m128i*)dxdy[j][0], dx);
+				_mm_store_si128((__m128i*)dxdy[j][1], dy);
+				// reject corner is selected by masks instead of the edge direction cases
+				__m128i right = _mm_cmpgt_epi32(dx, zero);
+				__m128i top = _mm_cmpgt_epi32(dy, ones);
+				// edge function at reject corner, it's exact in double
+				__m128i rcx = _mm_sub_epi32(_mm_and_si128(right, block_size), x[i1]);
+				__m128i rcy = _mm_sub_epi32(_mm_and_si128(top, block_size), y[i1]);
+				__m128d v0 = _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(dy), _mm_cvtepi32_pd(rcy)),
+					_mm_mul_pd(_mm_cvtepi32_pd(dx), _mm_cvtepi32_pd(rcx)));
+				__m128d v1 = _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(dy, 8)), _mm_cvtepi32_pd(_mm_srli_si128(rcy, 8))),
+					_mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(dx, 8)), _mm_cvtepi32_pd(_mm_srli_si128(rcx, 8))));
+				_mm_store_pd(rc_hp[j], v0);
+				_mm_store_pd(rc_hp[j] + 2, v1);
+			}
+
+			for(unsigned l = 0, n = std::min(count - beg, 4u); l < n; ++l)
+			{
+				Triangle *prim = prims + beg + l;
+				for(int i = 0; i < 4; ++i)
+					prim->bounding[i] = int16_t(bounding[i][l]);
+				for(int j = 0; j < 3; ++j)
+				{
+					prim->dxdy[j].setValue(dxdy[j][0][l], dxdy[j][1][l]);
+					int64_t v = int64_t(rc_hp[j][l]);
+					prim->rc_hp[j] = v;
+					for(int lod = 1; lod <= SPW_LOD_MAX; ++lod)
+						prim->lod_offset[j][lod - 1] = uint8_t(v >> triangle_lod_shift(lod) & SPW_TILE_SIZE_MASK);
+				}
+			}
+		}
+	}
+
+	// queue the single node below block level which contains the bounding box of a small triangle
+	// return false if the triangle should go through the block scan
+	static bool scan_small_triangle(RenderTarget *rt, const Triangle *prim, BlockArena *arena, TileQueue *full_blocks, TileQueue *partial_blocks, unsigned *count)
+	{
+		// pixel range of bounding box, relative to render target
+		int x0 = prim->bounding[0] - (rt->x << SPW_BLOCK_SIZE_BITS);
+		int y0 = prim->bounding[1] - (rt->y << SPW_BLOCK_SIZE_BITS);
+		int x1 = prim->bounding[2] - (rt->x << SPW_BLOCK_SIZE_BITS);
+		int y1 = prim->bounding[3] - (rt->y << SPW_BLOCK_SIZE_BITS);
+		if(x0 < 0 || y0 < 0 || x1 >= (rt->w << SPW_BLOCK_SIZE_BITS) || y1 >= (rt->h << SPW_BLOCK_SIZE_BITS))
+			return false;
+		// find the smallest node
+		int lod = SPW_LOD_MAX, size_bits = SPW_TILE_SIZE_BITS;
+		while(lod > 0 && ((x0 ^ x1) | (y0 ^ y1)) >> size_bits)
+		{
+			lod -= 1;
+			size_bits += SPW_TILE_SIZE_BITS;
+		}
+		if(lod <= 0)
+			return false;
+		int x = x0 & ~((1 << size_bits) - 1);
+		int y = y0 & ~((1 << size_bits) - 1);
+		// locate node in swizzled storage
+		int size = SPW_BLOCK_SIZE * SPW_BLOCK_SIZE * rt->pixel_size;
+		char *storage = rt->storage + (y >> SPW_BLOCK_SIZE_BITS) * rt->pitch * SPW_BLOCK_SIZE + (x >> SPW_BLOCK_SIZE_BITS) * size;
+		unsigned index = 0;
+		for(int l = 1, bits = SPW_BLOCK_SIZE_BITS; l <= lod; ++l)
+		{
+			bits -= SPW_TILE_SIZE_BITS;
+			index = index * 16 + ((y >> bits) & SPW_TILE_SIZE_MASK) * 4 + ((x >> bits) & SPW_TILE_SIZE_MASK);
+		}
+		size >>= lod * 4;
+		// edge function at reject corner of the node, rc_hp is at the reject corner of block (0, 0)
+		// node value is in unit of its size, and its shift is for the children
+		int unit = SPW_SUB_PIXEL_PRECISION + size_bits;
+		int64_t node_x = int64_t(x + (rt->x << SPW_BLOCK_SIZE_BITS)) << SPW_SUB_PIXEL_PRECISION;
+		int64_t node_y = int64_t(y + (rt->y << SPW_BLOCK_SIZE_BITS)) << SPW_SUB_PIXEL_PRECISION;
+		int64_t corner = int64_t((1 << size_bits) - SPW_BLOCK_SIZE) << SPW_SUB_PIXEL_PRECISION;
+		int64_t reject[3];
+		bool accept = true;
+		for(int j = 0; j < 3; ++j)
+		{
+			const vec2i &dv = prim->dxdy[j];
+			int64_t rx = dv.x > 0 ? node_x + corner : node_x;
+			int64_t ry = dv.y >= 0 ? node_y + corner : node_y;
+			reject[j] = (prim->rc_hp[j] + rx * dv.x + ry * dv.y) >> unit;
+			if(reject[j] < 0)
+				// trivial reject
+				return true;
+			if(reject[j] + edge_rc2ac(dv) <= 0)
+				accept = false;
+		}
+		auto *node = arena->alloc();
+		node->_next = nullptr;
+		node->storage = storage + index * size;
+		node->size = size;
+		node->shift = unit - SPW_TILE_SIZE_BITS;
+		node->lod = lod;
+		node->index = index;
+		for(int j = 0; j < 3; ++j)
+			node->reject[j] = reject[j];
+		*count += 1;
+		if(accept)
+			full_blocks->push(node);
+		else
+			partial_blocks->push(node);
+		return true;
+	}
+
 	unsigned scan_block(RenderTarget *rt, const Triangle *prim, BlockArena *arena, TileQueue *full_blocks, TileQueue *partial_blocks)
 	{
+		unsigned block_count = 0;
+		if(scan_small_triangle(rt, prim, arena, full_blocks, partial_blocks, &block_count))
+			return block_count;
 		// find blocks covered by primitive's aabb
 		// block range: {beg_col, beg_row, end_col, end_row}
-		vec4i bounding = prim->bounding;
-		constexpr int adjust = (SPW_BLOCK_SIZE << SPW_SUB_PIXEL_PRECISION) - 1;
-		unsigned block_count = 0;
-		bounding.z += adjust;
-		bounding.w += adjust;
-		bounding /= (SPW_BLOCK_SIZE << SPW_SUB_PIXEL_PRECISION);
-		vec4i block_range = {-rt->x, -rt->y, -rt->x, -rt->y};
-		block_range += bounding;
+		vec4i block_range = {
+			(prim->bounding[0] >> SPW_BLOCK_SIZE_BITS) - rt->x,
+			(prim->bounding[1] >> SPW_BLOCK_SIZE_BITS) - rt->y,
+			(prim->bounding[2] >> SPW_BLOCK_SIZE_BITS) + 1 - rt->x,
+			(prim->bounding[3] >> SPW_BLOCK_SIZE_BITS) + 1 - rt->y,
+		};
 		block_range.x = std::max(block_range.x, 0);
 		block_range.y = std::max(block_range.y, 0);
 		block_range.z = std::min(block_range.z, rt->w);
 		block_range.w = std::min(block_range.w, rt->h);
 		
 		// find partial covered blocks and full covered blocks
+		// edge function is evaluated in 64-bit at block level, so each block gets an exact reject value as its local origin
 		constexpr int block_shift = SPW_SUB_PIXEL_PRECISION + SPW_BLOCK_SIZE_BITS;
-		vec3i dy(prim->dxdy[0].y, prim->dxdy[1].y, prim->dxdy[2].y);
-		vec3i dx(prim->dxdy[0].x, prim->dxdy[1].x, prim->dxdy[2].x);
-		vec3i reject_row = {
-			int(prim->rc_hp[0] >> block_shift),
-			int(prim->rc_hp[1] >> block_shift),
-			int(prim->rc_hp[2] >> block_shift),
-		};
-		reject_row += dx * block_range.x;
-		reject_row += dy * block_range.y;
-		vec3i reject, accept;
+		int64_t dx[3], dy[3], reject_row[3];
+		int rc2ac[3];
+		for(int j = 0; j < 3; ++j)
+		{
+			rc2ac[j] = edge_rc2ac(prim->dxdy[j]);
+			dx[j] = prim->dxdy[j].x;
+			dy[j] = prim->dxdy[j].y;
+			// edge function is evaluated in render target space, where block (0, 0) is at (rt->x, rt->y)
+			reject_row[j] = (prim->rc_hp[j] >> block_shift) + dx[j] * (block_range.x + rt->x) + dy[j] * (block_range.y + rt->y);
+		}
+		int64_t reject[3];
 		// 4 ^ SPW_LOD_MAX = SPW_BLOCK_SIZE
 		constexpr int shift = SPW_SUB_PIXEL_PRECISION + SPW_LOD_MAX * 2;
 		int size = SPW_BLOCK_SIZE * SPW_BLOCK_SIZE * rt->pixel_size;
@@ -202,25 +279,35 @@ namespace wyc
 		unsigned row_size = rt->pitch * SPW_BLOCK_SIZE;
 //		unsigned col_size = SPW_BLOCK_SIZE * SPW_BLOCK_SIZE * rt->pixel_size;
 		char *row_start = rt->storage + block_range.y * row_size + block_range.x * size;
-		for(int r = block_range.y; r < block_range.w; ++r, reject_row += dy, row_start += row_size)
+		for(int r = block_range.y; r < block_range.w; ++r, row_start += row_size)
 		{
-			reject = reject_row;
+			for(int j = 0; j < 3; ++j)
+			{
+				reject[j] = reject_row[j];
+				reject_row[j] += dy[j];
+			}
 			char *storage = row_start;
-			for(int c = block_range.x; c < block_range.z; ++c, reject += dx, storage += size)
+			for(int c = block_range.x; c < block_range.z; ++c, storage += size)
 			{
-				if((reject.x | reject.y | reject.z) < 0)
+				int64_t r0 = reject[0], r1 = reject[1], r2 = reject[2];
+				reject[0] += dx[0];
+				reject[1] += dx[1];
+				reject[2] += dx[2];
+				if((r0 | r1 | r2) < 0)
 					// trivial reject
 					continue;
-				accept = reject + prim->rc2ac;
 				auto *block = arena->alloc();
 				block->_next = nullptr;
 				block->storage = storage;
 				block->size = size;
 				block->shift = shift;
 				block->lod = 0;
-				block->reject = reject;
+				block->index = 0;
+				block->reject[0] = r0;
+				block->reject[1] = r1;
+				block->reject[2] = r2;
 				block_count += 1;
-				if((accept.x | accept.y | accept.z) > 0) {
+				if(((r0 + rc2ac[0]) | (r1 + rc2ac[1]) | (r2 + rc2ac[2])) > 0) {
 					// trivial accept
 					full_blocks->push(block);
 				}
@@ -233,182 +320,501 @@ namespace wyc
 		return block_count;
 	}
 	
-	void scan_tile(const Triangle *prim, TileBlock *block, BlockArena *arena, TileQueue *full_tiles, TileQueue *partial_tiles)
-	{
-		int shift = block->shift;
-		// todo: per triangle constant
-		vec3i r = {
-			int(prim->rc_hp[0] >> shift) & SPW_TILE_SIZE_MASK,
-			int(prim->rc_hp[1] >> shift) & SPW_TILE_SIZE_MASK,
-			int(prim->rc_hp[2] >> shift) & SPW_TILE_SIZE_MASK,
-		};
-		r.x += block->reject.x << SPW_TILE_SIZE_BITS;
-		r.y += block->reject.y << SPW_TILE_SIZE_BITS;
-		r.z += block->reject.z << SPW_TILE_SIZE_BITS;
-		mat4i m0(r.x);
-		mat4i m1(r.y);
-		mat4i m2(r.z);
-		m0 += prim->rc_steps[0];
-		m1 += prim->rc_steps[1];
-		m2 += prim->rc_steps[2];
-		mat4i mask = m0 | m1;
-		mask |= m2;
-		int *x0 = (int*)m0.x;
-		int *x1 = (int*)m1.x;
-		int *x2 = (int*)m2.x;
-		int *xm = (int*)mask.x;
-		shift -= 2;
-		int size = block->size >> 4;
-		int lod = block->lod + 1;
-		char* storage = block->storage;
-		for(int i = 0; i < 16; ++i, storage += size)
+	// node values of the SIMD test are saturated to this value, so they stay in 32-bit at every LOD
+	// a node whose reject corner is above it is inside the edge, and so are its children
+	static constexpr int64_t edge_saturation = 1 << 28;
+	// edge values of a 4x4 tile which can be evaluated by the 32-bit coverage kernels
+	static constexpr int64_t edge_limit = 1 << 30;
+
+	// per triangle constants of the tile path, derived from the compact Triangle once per block
+	struct EdgeSteps
+	{
+		// 4x4 reject corner offsets of the children of a node, 64 bytes aligned for AVX2/AVX-512 loads
+		alignas(64) int rc_steps[3][16];
+		// low bits of full precision edge function value
+		float tail[3];
+		// pixel center offset
+		int center_offset[3];
+		// edge function offsets of the multi-sampling positions, in 1/8 pixel
+		int sample_steps[3][SPW_MSAA_SAMPLES];
+	};
+
+	static void init_edge_steps(const Triangle *prim, EdgeSteps *steps)
+	{
+		constexpr int last_shift = SPW_SUB_PIXEL_PRECISION + SPW_TILE_SIZE_BITS;
+		constexpr int last_mask = (1 << last_shift) - 1;
+		for(int j = 0; j < 3; ++j)
 		{
-			if(xm[i] < 0)
-				continue;
-			vec3i reject(x0[i], x1[i], x2[i]);
-			vec3i accept = reject + prim->rc2ac;
-			TileBlock *b = arena->alloc();
-			b->_next = nullptr;
-			b->storage = storage;
-			b->size = size;
-			b->shift = shift;
-			b->lod = lod;
-			b->reject = reject;
-			if((accept.x | accept.y | accept.z) > 0) {
-				full_tiles->push(b);
-			}
-			else {
-				partial_tiles->push(b);
-			}
+			const vec2i &dv = prim->dxdy[j];
+			__m128i row = _mm_add_epi32(_mm_set1_epi32(edge_step_base(dv)), _mm_setr_epi32(0, dv.x, dv.x * 2, dv.x * 3));
+			__m128i dy = _mm_set1_epi32(dv.y);
+			for(int k = 0; k < 4; ++k, row = _mm_add_epi32(row, dy))
+				_mm_store_si128((__m128i*)(steps->rc_steps[j] + k * 4), row);
+			int64_t v = prim->rc_hp[j];
+			int b = edge_bias(dv);
+			// .8 sub-pixel part with reversed bias
+			steps->tail[j] = float(int((v + b) & 0xFF) - b) / 256;
+			// factor to calculate full precision edge function at pixel center (0.5 sub-pixel precision)
+			steps->center_offset[j] = int(v & last_mask) + (edge_rc2ac(dv) << 7) + b;
+			for(int s = 0; s < SPW_MSAA_SAMPLES; ++s)
+				steps->sample_steps[j][s] = dv.x * msaa_sample_offset[s][0] + dv.y * msaa_sample_offset[s][1];
 		}
 	}
-		
-	void draw_tile(const Triangle *prim, TileBlock *tile, PixelShader shader)
+
+	// edge function values at the first pixel of a 4x4 tile
+	// return false if any of them is out of the 32-bit kernel range
+	static inline bool tile_edge_value(const EdgeSteps *steps, const TileBlock *tile, int64_t e[3])
 	{
 		constexpr int last_shift = SPW_SUB_PIXEL_PRECISION + SPW_TILE_SIZE_BITS;
-//		constexpr int last_mask = (1 << last_shift) - 1;
-//		assert(tile->shift == last_shift);
-		int e[3];
+		bool in_range = true;
 		for(int i=0; i<3; ++i)
 		{
 			int64_t r = tile->reject[i];
 			// recover the full precision edge function at reject corner
 			r <<= last_shift;
-			
-//			r |= prim->rc_hp[i] & last_mask;
-//			// edge function at pixel center (0.5 sub-pixel precision)
-//			r += prim->rc2ac[i] << 7;
-//			// add the top-left rule bias
-//			r += prim->bias[i];
-			
-			r += prim->center_offset[i];
-			e[i] = int(r >> SPW_SUB_PIXEL_PRECISION);
+			r += steps->center_offset[i];
+			e[i] = r >> SPW_SUB_PIXEL_PRECISION;
+			if(e[i] >= edge_limit || e[i] <= -edge_limit)
+				in_range = false;
 		}
+		return in_range;
+	}
 
-		mat4i m0 = e[0];
-		mat4i m1 = e[1];
-		mat4i m2 = e[2];
-		m0 += prim->rc_steps[0];
-		m1 += prim->rc_steps[1];
-		m2 += prim->rc_steps[2];
-		mat4i mask = m0 | m1;
-		mask |= m2;
-
-		int *x0 = (int*)m0.x;
-		int *x1 = (int*)m1.x;
-		int *x2 = (int*)m2.x;
-		int *xm = (int*)mask.x;
-
-		constexpr int PIXEL_SIZE = 4;
-		char *dst = tile->storage;
-		for(int i = 0; i < 16; ++i, ++xm, dst += PIXEL_SIZE) {
-			if(*xm < 0)
-				continue;
-			vec3f w(x0[i], x1[i], x2[i]);
-			w += prim->tail;
-			float sum = w.x + w.y + w.z;
-			w /= sum;
-			shader(dst, w);
+	// 64-bit version of the coverage kernel, for the tiles of large triangles
+	static unsigned tile_coverage_wide(const int64_t *e, const int *steps, const float *tail, float *w)
+	{
+		unsigned mask = 0;
+		for(int i = 0; i < 16; ++i)
+		{
+			int64_t x0 = e[0] + steps[i];
+			int64_t x1 = e[1] + steps[16 + i];
+			int64_t x2 = e[2] + steps[32 + i];
+			if((x0 | x1 | x2) >= 0)
+				mask |= 1 << i;
+			float w0 = float(x0) + tail[0];
+			float w1 = float(x1) + tail[1];
+			float w2 = float(x2) + tail[2];
+			float inv = 1.0f / (w0 + w1 + w2);
+			w[i] = w0 * inv;
+			w[16 + i] = w1 * inv;
+			w[32 + i] = w2 * inv;
 		}
+		return mask;
 	}
-		
-	void split_tile(const Triangle *prim, BlockArena *arena, TileBlock *block, TileQueue *full_tiles)
-	{
-		int shift = block->shift;
-		// todo: per triangle constant
-		vec3i r = {
-			int(prim->rc_hp[0] >> shift) & SPW_TILE_SIZE_MASK,
-			int(prim->rc_hp[1] >> shift) & SPW_TILE_SIZE_MASK,
-			int(prim->rc_hp[2] >> shift) & SPW_TILE_SIZE_MASK,
-		};
-		r.x += block->reject.x << SPW_TILE_SIZE_BITS;
-		r.y += block->reject.y << SPW_TILE_SIZE_BITS;
-		r.z += block->reject.z << SPW_TILE_SIZE_BITS;
-		mat4i m0(r.x);
-		mat4i m1(r.y);
-		mat4i m2(r.z);
-		m0 += prim->rc_steps[0];
-		m1 += prim->rc_steps[1];
-		m2 += prim->rc_steps[2];
-		int *x0 = (int*)m0.x;
-		int *x1 = (int*)m1.x;
-		int *x2 = (int*)m2.x;
-		shift -= 2;
-		int size = block->size >> 4;
-		int lod = block->lod + 1;
-		char* storage = block->storage;
-		for(int i = 0; i < 16; ++i, storage += size)
+
+	// portable version of the coverage kernel
+	static unsigned tile_coverage_scalar(const int *e, const int *steps, const float *tail, float *w)
+	{
+		unsigned mask = 0;
+		for(int i = 0; i < 16; ++i)
 		{
-			vec3i reject(x0[i], x1[i], x2[i]);
-			TileBlock *b = arena->alloc();
-			b->_next = nullptr;
-			b->storage = storage;
-			b->size = size;
-			b->shift = shift;
-			b->lod = lod;
-			b->reject = reject;
-			full_tiles->push(b);
+			int x0 = e[0] + steps[i];
+			int x1 = e[1] + steps[16 + i];
+			int x2 = e[2] + steps[32 + i];
+			if((x0 | x1 | x2) >= 0)
+				mask |= 1 << i;
+			float w0 = x0 + tail[0];
+			float w1 = x1 + tail[1];
+			float w2 = x2 + tail[2];
+			float inv = 1.0f / (w0 + w1 + w2);
+			w[i] = w0 * inv;
+			w[16 + i] = w1 * inv;
+			w[32 + i] = w2 * inv;
 		}
+		return mask;
 	}
 
-	void fill_tile(const Triangle *prim, TileBlock *tile, PixelShader shader)
+	struct CoverageKernelInfo
+	{
+		const char *name;
+		TileCoverageKernel kernel;
+	};
+
+	static CoverageKernelInfo select_coverage_kernel()
+	{
+		const auto &info = get_platform_info();
+		if(info.has_avx512)
+			return { "avx512", &tile_coverage_avx512 };
+		if(info.has_avx2)
+			return { "avx2", &tile_coverage_avx2 };
+		if(info.has_sse4_1)
+			return { "sse4", &tile_coverage_sse4 };
+		return { "scalar", &tile_coverage_scalar };
+	}
+
+	static CoverageKernelInfo& coverage_kernel()
+	{
+		static CoverageKernelInfo ls_kernel = select_coverage_kernel();
+		return ls_kernel;
+	}
+
+	const char* tile_coverage_kernel()
+	{
+		return coverage_kernel().name;
+	}
+
+	bool set_tile_coverage_kernel(const char *name)
+	{
+		const auto &info = get_platform_info();
+		CoverageKernelInfo kernel = { nullptr, nullptr };
+		if(!strcmp(name, "avx512") && info.has_avx512)
+			kernel = { "avx512", &tile_coverage_avx512 };
+		else if(!strcmp(name, "avx2") && info.has_avx2)
+			kernel = { "avx2", &tile_coverage_avx2 };
+		else if(!strcmp(name, "sse4") && info.has_sse4_1)
+			kernel = { "sse4", &tile_coverage_sse4 };
+		else if(!strcmp(name, "scalar"))
+			kernel = { "scalar", &tile_coverage_scalar };
+		if(!kernel.kernel)
+			return false;
+		coverage_kernel() = kernel;
+		return true;
+	}
+
+	static inline void tile_coverage(const EdgeSteps *steps, const TileBlock *tile, TileCoverage *coverage)
+	{
+		int64_t e[3];
+		if(tile_edge_value(steps, tile, e)) {
+			const int e32[3] = { int(e[0]), int(e[1]), int(e[2]) };
+			coverage->mask = coverage_kernel().kernel(e32, &steps->rc_steps[0][0], steps->tail, &coverage->w[0][0]);
+		}
+		else {
+			coverage->mask = tile_coverage_wide(e, &steps->rc_steps[0][0], steps->tail, &coverage->w[0][0]);
+		}
+	}
+
+	// sample s of pixel i is inside of edge if (F >> 5) + rc_steps[i] * 8 + sample_steps[s] >= 0,
+	// where F is the full precision edge function at the first pixel, since sample offsets are in 1/8 pixel
+	static void tile_sample_mask(const EdgeSteps *steps, const TileBlock *tile, unsigned *sample_mask)
 	{
 		constexpr int last_shift = SPW_SUB_PIXEL_PRECISION + SPW_TILE_SIZE_BITS;
-//		constexpr int last_mask = (1 << last_shift) - 1;
-//		assert(tile->shift == last_shift);
-		int e[3];
-		for(int i=0; i<3; ++i)
+		constexpr int sample_shift = SPW_SUB_PIXEL_PRECISION - 3;
+		int64_t e[3];
+		bool in_range = true;
+		for(int j = 0; j < 3; ++j)
 		{
-			int64_t r = tile->reject[i];
-			// recover the full precision edge function at reject corner
-			r <<= last_shift;
+			e[j] = ((tile->reject[j] << last_shift) + steps->center_offset[j]) >> sample_shift;
+			if(e[j] >= edge_limit / 4 || e[j] <= -edge_limit / 4)
+				in_range = false;
+		}
+		if(!in_range) {
+			for(int s = 0; s < SPW_MSAA_SAMPLES; ++s)
+			{
+				unsigned mask = 0;
+				for(int i = 0; i < 16; ++i)
+				{
+					int64_t x0 = e[0] + steps->rc_steps[0][i] * 8 + steps->sample_steps[0][s];
+					int64_t x1 = e[1] + steps->rc_steps[1][i] * 8 + steps->sample_steps[1][s];
+					int64_t x2 = e[2] + steps->rc_steps[2][i] * 8 + steps->sample_steps[2][s];
+					if((x0 | x1 | x2) >= 0)
+						mask |= 1 << i;
+				}
+				sample_mask[s] = mask;
+			}
+			return;
+		}
+		for(int s = 0; s < SPW_MSAA_SAMPLES; ++s)
+		{
+			const __m128i e0 = _mm_set1_epi32(int(e[0]) + steps->sample_steps[0][s]);
+			const __m128i e1 = _mm_set1_epi32(int(e[1]) + steps->sample_steps[1][s]);
+			const __m128i e2 = _mm_set1_epi32(int(e[2]) + steps->sample_steps[2][s]);
+			unsigned outside = 0;
+			for(int i = 0; i < 16; i += 4)
+			{
+				__m128i x0 = _mm_add_epi32(e0, _mm_slli_epi32(_mm_load_si128((const __m128i*)(steps->rc_steps[0] + i)), 3));
+				__m128i x1 = _mm_add_epi32(e1, _mm_slli_epi32(_mm_load_si128((const __m128i*)(steps->rc_steps[1] + i)), 3));
+				__m128i x2 = _mm_add_epi32(e2, _mm_slli_epi32(_mm_load_si128((const __m128i*)(steps->rc_steps[2] + i)), 3));
+				__m128i sign = _mm_or_si128(_mm_or_si128(x0, x1), x2);
+				outside |= unsigned(_mm_movemask_ps(_mm_castsi128_ps(sign))) << i;
+			}
+			sample_mask[s] = ~outside & 0xFFFF;
+		}
+	}
+
+	static inline void tile_sample_coverage(const EdgeSteps *steps, const TileBlock *tile, TileCoverage *coverage)
+	{
+		tile_coverage(steps, tile, coverage);
+		tile_sample_mask(steps, tile, coverage->sample_mask);
+		coverage->mask = 0;
+		for(int s = 0; s < SPW_MSAA_SAMPLES; ++s)
+			coverage->mask |= coverage->sample_mask[s];
+	}
+
+	static inline void draw_tile(const EdgeSteps *steps, TileBlock *tile, TileShader shader, void *ctx, bool multisample)
+	{
+		TileCoverage coverage;
+		if(multisample)
+			tile_sample_coverage(steps, tile, &coverage);
+		else
+			tile_coverage(steps, tile, &coverage);
+		if(coverage.mask)
+			shader(ctx, tile->storage, coverage);
+	}
+
+	static inline void fill_tile(const EdgeSteps *steps, TileBlock *tile, TileShader shader, void *ctx, bool multisample)
+	{
+		TileCoverage coverage;
+		tile_coverage(steps, tile, &coverage);
+		// accepted by the hierarchical test, all pixels (and samples) are inside
+		coverage.mask = 0xFFFF;
+		if(multisample)
+			std::fill(std::begin(coverage.sample_mask), std::end(coverage.sample_mask), 0xFFFF);
+		shader(ctx, tile->storage, coverage);
+	}
+
+	void tile_coverage(const Triangle *prim, const TileBlock *tile, TileCoverage *coverage)
+	{
+		EdgeSteps steps;
+		init_edge_steps(prim, &steps);
+		tile_coverage(&steps, tile, coverage);
+	}
+
+	void tile_sample_coverage(const Triangle *prim, const TileBlock *tile, TileCoverage *coverage)
+	{
+		EdgeSteps steps;
+		init_edge_steps(prim, &steps);
+		tile_sample_coverage(&steps, tile, coverage);
+	}
+
+	void draw_tile(const Triangle *prim, TileBlock *tile, TileShader shader, void *ctx)
+	{
+		EdgeSteps steps;
+		init_edge_steps(prim, &steps);
+		draw_tile(&steps, tile, shader, ctx, false);
+	}
+		
+	void fill_tile(const Triangle *prim, TileBlock *tile, TileShader shader, void *ctx)
+	{
+		EdgeSteps steps;
+		init_edge_steps(prim, &steps);
+		fill_tile(&steps, tile, shader, ctx, false);
+	}
+
+	// index of the lowest set bit, v should not be 0
+	static inline unsigned bit_scan_forward(unsigned v)
+	{
+#ifdef _MSC_VER
+		unsigned long i;
+		_BitScanForward(&i, v);
+		return unsigned(i);
+#else
+		return unsigned(__builtin_ctz(v));
+#endif
+	}
+
+	// the 16 children of a block or tile
+	struct TileLevel
+	{
+		// edge function values at reject corner of the children, in SoA layout
+		// they are saturated to edge_saturation, exact values are restored from "base" when a child is visited
+		alignas(16) int reject[3][16];
+		// exact edge function values at reject corner of the children are base + rc_steps
+		int64_t base[3];
+		// bit i is set if child i is partially covered
+		unsigned partial;
+		// bit i is set if child i is fully covered
+		unsigned full;
+		// storage of the first child
+		char *storage;
+		// storage size, shift and lod of the children
+		int size;
+		int shift;
+		int lod;
+		// index of the first child in its LOD
+		unsigned index;
+	};
+
+	// test the 16 children of a node with 4 children per SSE register
+	// reject is of the parent node, full is set if the parent is fully covered
+	// reject corner offsets of the children are stepped by dxdy in registers
+	static inline void scan_children(const Triangle *prim, const int64_t *reject, bool full, TileLevel *level)
+	{
+		__m128i r[3], ac[3], dy[3];
+		for(int j = 0; j < 3; ++j)
+		{
+			const vec2i &dv = prim->dxdy[j];
+			int64_t low = prim->lod_offset[j][level->lod - 1];
+			level->base[j] = low + reject[j] * (1 << SPW_TILE_SIZE_BITS);
+			int v = int(low + std::min(reject[j], edge_saturation) * (1 << SPW_TILE_SIZE_BITS)) + edge_step_base(dv);
+			r[j] = _mm_add_epi32(_mm_set1_epi32(v), _mm_setr_epi32(0, dv.x, dv.x * 2, dv.x * 3));
+			ac[j] = _mm_set1_epi32(edge_rc2ac(dv));
+			dy[j] = _mm_set1_epi32(dv.y);
+		}
+		const __m128i zero = _mm_setzero_si128();
+		unsigned outside = 0, inside = 0;
+		for(int k = 0; k < 4; ++k)
+		{
+			__m128i x0 = r[0], x1 = r[1], x2 = r[2];
+			r[0] = _mm_add_epi32(x0, dy[0]);
+			r[1] = _mm_add_epi32(x1, dy[1]);
+			r[2] = _mm_add_epi32(x2, dy[2]);
+			_mm_store_si128((__m128i*)(level->reject[0] + k * 4), x0);
+			_mm_store_si128((__m128i*)(level->reject[1] + k * 4), x1);
+			_mm_store_si128((__m128i*)(level->reject[2] + k * 4), x2);
+			if(full)
+				continue;
+			// trivial reject if any edge is negative at reject corner
+			__m128i m = _mm_or_si128(_mm_or_si128(x0, x1), x2);
+			outside |= unsigned(_mm_movemask_ps(_mm_castsi128_ps(m))) << (k * 4);
+			// trivial accept if all edges are positive at accept corner
+			__m128i a0 = _mm_add_epi32(x0, ac[0]);
+			__m128i a1 = _mm_add_epi32(x1, ac[1]);
+			__m128i a2 = _mm_add_epi32(x2, ac[2]);
+			m = _mm_cmpgt_epi32(_mm_or_si128(_mm_or_si128(a0, a1), a2), zero);
+			inside |= unsigned(_mm_movemask_ps(_mm_castsi128_ps(m))) << (k * 4);
+		}
+		if(full) {
+			level->full = 0xFFFF;
+			level->partial = 0;
+		}
+		else {
+			unsigned covered = ~outside & 0xFFFF;
+			level->full = covered & inside;
+			level->partial = covered & ~inside;
+		}
+	}
+
+	void init_block_depth(BlockDepth *coarse, const float *depth, unsigned sample_count)
+	{
+		constexpr unsigned tile_offset = block_depth_offset(SPW_LOD_MAX);
+		const unsigned tile_size = 16 * sample_count;
+		for(unsigned i = 0; i < 256; ++i, depth += tile_size)
+		{
+			float zmin = depth[0], zmax = depth[0];
+			for(unsigned k = 1; k < tile_size; ++k)
+			{
+				zmin = std::min(zmin, depth[k]);
+				zmax = std::max(zmax, depth[k]);
+			}
+			coarse->zmin[tile_offset + i] = zmin;
+			coarse->zmax[tile_offset + i] = zmax;
+		}
+		for(int lod = SPW_LOD_MAX - 1; lod >= 0; --lod)
+		{
+			unsigned offset = block_depth_offset(lod);
+			unsigned child_offset = block_depth_offset(lod + 1);
+			for(unsigned i = 0, count = 1 << (lod * 4); i < count; ++i)
+			{
+				const float *child_min = coarse->zmin + child_offset + i * 16;
+				const float *child_max = coarse->zmax + child_offset + i * 16;
+				coarse->zmin[offset + i] = *std::min_element(child_min, child_min + 16);
+				coarse->zmax[offset + i] = *std::max_element(child_max, child_max + 16);
+			}
+		}
+	}
+
+	void update_block_depth(BlockDepth *coarse, unsigned tile, const float *depth, unsigned sample_count)
+	{
+		unsigned index = block_depth_offset(SPW_LOD_MAX) + tile;
+		coarse->zmin[index] = *std::min_element(depth, depth + 16 * sample_count);
+		coarse->zmax[index] = *std::max_element(depth, depth + 16 * sample_count);
+		// propagate to parents
+		for(int lod = SPW_LOD_MAX - 1; lod >= 0; --lod)
+		{
+			tile >>= 4;
+			const float *child_min = coarse->zmin + block_depth_offset(lod + 1) + tile * 16;
+			const float *child_max = coarse->zmax + block_depth_offset(lod + 1) + tile * 16;
+			index = block_depth_offset(lod) + tile;
+			coarse->zmin[index] = *std::min_element(child_min, child_min + 16);
+			coarse->zmax[index] = *std::max_element(child_max, child_max + 16);
+		}
+	}
 
-//			r |= prim->rc_hp[i] & last_mask;
-//			// edge function at pixel center (0.5 sub-pixel precision)
-//			r += prim->rc2ac[i] << 7;
-//			// add the top-left rule bias
-//			r += prim->bias[i];
-			
-			r += prim->center_offset[i];
-			e[i] = int(r >> SPW_SUB_PIXEL_PRECISION);
+	// mask of the children which are behind the coarse depth
+	static inline unsigned occluded_children(const BlockDepth *coarse, const TileLevel *level, float zmin)
+	{
+		const float *zmax = coarse->zmax + block_depth_offset(level->lod) + level->index;
+		__m128 z = _mm_set1_ps(zmin);
+		unsigned mask = 0;
+		for(int k = 0; k < 4; ++k)
+		{
+			__m128 m = _mm_cmpge_ps(z, _mm_loadu_ps(zmax + k * 4));
+			mask |= unsigned(_mm_movemask_ps(m)) << (k * 4);
 		}
-		mat4i m0 = e[0];
-		mat4i m1 = e[1];
-		mat4i m2 = e[2];
-		m0 += prim->rc_steps[0];
-		m1 += prim->rc_steps[1];
-		m2 += prim->rc_steps[2];
-		int *x0 = (int*)m0.x;
-		int *x1 = (int*)m1.x;
-		int *x2 = (int*)m2.x;
-		constexpr int PIXEL_SIZE = 4;
-		char *dst = tile->storage;
-		for(int i = 0; i < 16; ++i, dst += PIXEL_SIZE) {
-			vec3f w(x0[i], x1[i], x2[i]);
-			w += prim->tail;
-			float sum = w.x + w.y + w.z;
-			w /= sum;
-			shader(dst, w);
+		return mask;
+	}
+
+	void rasterize_block(const Triangle *prim, const TileBlock *block, bool full, TileShader shader, void *ctx,
+		const BlockDepth *coarse, float zmin, bool multisample)
+	{
+		TileBlock tile;
+		tile._next = nullptr;
+		EdgeSteps steps;
+		if(block->lod == SPW_LOD_MAX) {
+			// a single tile of small triangle
+			if(coarse && zmin >= coarse->zmax[block_depth_offset(SPW_LOD_MAX) + block->index])
+				return;
+			init_edge_steps(prim, &steps);
+			tile = *block;
+			if(full)
+				fill_tile(&steps, &tile, shader, ctx, multisample);
+			else
+				draw_tile(&steps, &tile, shader, ctx, multisample);
+			return;
+		}
+		init_edge_steps(prim, &steps);
+		// one level for each LOD below the block
+		TileLevel stack[SPW_LOD_MAX];
+		int top = 0;
+		TileLevel *level = stack;
+		level->storage = block->storage;
+		level->size = block->size >> 4;
+		level->shift = block->shift - 2;
+		level->lod = block->lod + 1;
+		level->index = block->index * 16;
+		scan_children(prim, block->reject, full, level);
+		if(coarse) {
+			unsigned occluded = occluded_children(coarse, level, zmin);
+			level->partial &= ~occluded;
+			level->full &= ~occluded;
+		}
+		while(top >= 0)
+		{
+			level = stack + top;
+			unsigned covered = level->partial | level->full;
+			if(!covered) {
+				top -= 1;
+				continue;
+			}
+			unsigned i = bit_scan_forward(covered);
+			unsigned bit = 1u << i;
+			bool is_full = (level->full & bit) != 0;
+			level->partial &= ~bit;
+			level->full &= ~bit;
+			int64_t reject[3];
+			for(int j = 0; j < 3; ++j)
+				reject[j] = level->base[j] + steps.rc_steps[j][i];
+			char *storage = level->storage + i * level->size;
+			if(level->lod < SPW_LOD_MAX) {
+				// descend into child
+				assert(top + 1 < SPW_LOD_MAX);
+				TileLevel *child = stack + (++top);
+				child->storage = storage;
+				child->size = level->size >> 4;
+				child->shift = level->shift - 2;
+				child->lod = level->lod + 1;
+				child->index = (level->index + i) * 16;
+				scan_children(prim, reject, is_full, child);
+				if(coarse) {
+					unsigned occluded = occluded_children(coarse, child, zmin);
+					child->partial &= ~occluded;
+					child->full &= ~occluded;
+				}
+			}
+			else {
+				tile.storage = storage;
+				tile.size = level->size;
+				tile.shift = level->shift;
+				tile.lod = level->lod;
+				tile.index = level->index + i;
+				tile.reject[0] = reject[0];
+				tile.reject[1] = reject[1];
+				tile.reject[2] = reject[2];
+				if(is_full)
+					fill_tile(&steps, &tile, shader, ctx, multisample);
+				else
+					draw_tile(&steps, &tile, shader, ctx, multisample);
+			}
 		}
 	}
 
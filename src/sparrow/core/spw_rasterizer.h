@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <vector>
 #include <ImathExc.h>
 #include <ImathBox.h>
@@ -11,6 +12,12 @@
 #define SPW_LOD_MAX (SPW_LOD_COUNT - 1)
 #define SPW_BLOCK_SIZE 64
 #define SPW_BLOCK_SIZE_BITS 6
+// number of triangles set up at once by setup_triangles
+#define SPW_SETUP_BATCH 8
+// max render target size, vertex coordinates should be inside [-SPW_MAX_TARGET_SIZE, SPW_MAX_TARGET_SIZE)
+#define SPW_MAX_TARGET_SIZE 16384
+// sample count of multi-sampled render target
+#define SPW_MSAA_SAMPLES 4
 
 namespace wyc
 {
@@ -155,14 +162,14 @@ namespace wyc
 	template<typename Vector, typename Plotter>
 	void fill_triangle(const box2i &block, const Vector &pos0, const Vector &pos1, const Vector &pos2, Plotter &plot)
 	{
-		// 11.8 sub pixel precision
-		// max render target is 2048 x 2048
-		// coordinate must be inside [-1024, 1024)
-		ASSERT_INSIDE(block.min, 1024);
-		ASSERT_INSIDE(block.max, 1024);
-		ASSERT_INSIDE(pos0, 1024);
-		ASSERT_INSIDE(pos1, 1024);
-		ASSERT_INSIDE(pos2, 1024);
+		// 15.8 sub pixel precision
+		// max render target is 16384 x 16384
+		// coordinate must be inside [-16384, 16384)
+		ASSERT_INSIDE(block.min, SPW_MAX_TARGET_SIZE);
+		ASSERT_INSIDE(block.max, SPW_MAX_TARGET_SIZE);
+		ASSERT_INSIDE(pos0, SPW_MAX_TARGET_SIZE);
+		ASSERT_INSIDE(pos1, SPW_MAX_TARGET_SIZE);
+		ASSERT_INSIDE(pos2, SPW_MAX_TARGET_SIZE);
 		
 		// snap to .8 sub pixel
 		vec2i v0 = snap_to_subpixel<8>(pos0);
@@ -190,16 +197,17 @@ namespace wyc
 		int edge_a20 = v2.y - v0.y, edge_b20 = v0.x - v2.x;
 
 		// edge function increment
-		int row_w0 = int(hp_w0 >> 8);
-		int row_w1 = int(hp_w1 >> 8);
-		int row_w2 = int(hp_w2 >> 8);
+		// values are kept in 64-bit, since edges of a large triangle can be far away from the block
+		int64_t row_w0 = hp_w0 >> 8;
+		int64_t row_w1 = hp_w1 >> 8;
+		int64_t row_w2 = hp_w2 >> 8;
 
 		// .8 sub pixel part which is constant during iteration
 		float fw0 = ((hp_w0 & 0xFF) - bias_v12) / 255.0f;
 		float fw1 = ((hp_w1 & 0xFF) - bias_v20) / 255.0f;
 		float fw2 = ((hp_w2 & 0xFF) - bias_v01) / 255.0f;
 
-		int w0, w1, w2;
+		int64_t w0, w1, w2;
 		float t_sum, t0, t1, t2;
 		for (int y = block.min.y; y < block.max.y; y += 1)
 		{
@@ -242,14 +250,14 @@ namespace wyc
 	template<typename Vector, typename Plotter>
 	void fill_triangle_quad(const box2i &block, const Vector &pos0, const Vector &pos1, const Vector &pos2, Plotter &plot)
 	{
-		// 11.8 sub pixel precision
-		// max render target is 2048 x 2048
-		// coordinate must be inside [-1024, 1024)
-		ASSERT_INSIDE(block.min, 1024);
-		ASSERT_INSIDE(block.max, 1024);
-		ASSERT_INSIDE(pos0, 1024);
-		ASSERT_INSIDE(pos1, 1024);
-		ASSERT_INSIDE(pos2, 1024);
+		// 15.8 sub pixel precision
+		// max render target is 16384 x 16384
+		// coordinate must be inside [-16384, 16384)
+		ASSERT_INSIDE(block.min, SPW_MAX_TARGET_SIZE);
+		ASSERT_INSIDE(block.max, SPW_MAX_TARGET_SIZE);
+		ASSERT_INSIDE(pos0, SPW_MAX_TARGET_SIZE);
+		ASSERT_INSIDE(pos1, SPW_MAX_TARGET_SIZE);
+		ASSERT_INSIDE(pos2, SPW_MAX_TARGET_SIZE);
 		// block size must be 2x2 at least
 		assert((block.max.x - block.min.x) > 1 && (block.max.y - block.min.y) > 1);
 		// block size must be even
@@ -280,19 +288,20 @@ namespace wyc
 		int bias_v20 = is_top_left(v2, v0) ? 0 : -1;
 
 		// edge function increment
-		vec4i row_w0, row_w1, row_w2;
+		// values are kept in 64-bit, since edges of a large triangle can be far away from the block
+		vec4l row_w0, row_w1, row_w2;
 
-		row_w0.x = int(hp_w0 >> 8) + bias_v12;
+		row_w0.x = (hp_w0 >> 8) + bias_v12;
 		row_w0.y = row_w0.x + edge_a12;
 		row_w0.z = row_w0.x + edge_b12;
 		row_w0.w = row_w0.z + edge_a12;
 
-		row_w1.x = int(hp_w1 >> 8) + bias_v20;
+		row_w1.x = (hp_w1 >> 8) + bias_v20;
 		row_w1.y = row_w1.x + edge_a20;
 		row_w1.z = row_w1.x + edge_b20;
 		row_w1.w = row_w1.z + edge_a20;
 
-		row_w2.x = int(hp_w2 >> 8) + bias_v01;
+		row_w2.x = (hp_w2 >> 8) + bias_v01;
 		row_w2.y = row_w2.x + edge_a01;
 		row_w2.z = row_w2.x + edge_b01;
 		row_w2.w = row_w2.z + edge_a01;
@@ -310,7 +319,7 @@ namespace wyc
 		float fw2 = float(hp_w2 & 0xFF) / 255;
 
 		//int w0, w1, w2;
-		vec4i w0, w1, w2, flag;
+		vec4l w0, w1, w2, flag;
 		//float t_sum, t0, t1, t2;
 		vec4f t_sum, t0, t1, t2;
 		
@@ -330,7 +339,9 @@ namespace wyc
 					t0 /= t_sum;
 					t1 /= t_sum;
 					t2 /= t_sum;
-					plot(x, y, (t0 * pos0.z) + (t1 * pos1.z) + (t2 * pos2.z), flag, t0, t1, t2);
+					// only the sign of flag is used by plotter
+					vec4i is_inside(int(flag.x >> 32), int(flag.y >> 32), int(flag.z >> 32), int(flag.w >> 32));
+					plot(x, y, (t0 * pos0.z) + (t1 * pos1.z) + (t2 * pos2.z), is_inside, t0, t1, t2);
 				}
 				else {
 					flag = { 0, 0, 0, 0 };
@@ -354,25 +365,26 @@ namespace wyc
 #define SPW_LOD_BITS 2
 #define SPW_LOD_MASK 3
 
-	struct Triangle
+	// shift of the edge function (in full precision) to the reject corners of the nodes of a LOD
+	constexpr int triangle_lod_shift(int lod)
 	{
-		// bouding box of triangle
-		vec4i bounding;
-		// 4x4 reject corner offsets
-		alignas(64) mat4i rc_steps[3];
-		// offset of reject corner to accept corner
-		vec3i rc2ac;
-		// edge function value at reject corner (high precision)
+		return SPW_SUB_PIXEL_PRECISION + SPW_BLOCK_SIZE_BITS - lod * SPW_TILE_SIZE_BITS;
+	}
+
+	// triangle setup result, it fits in a cache line
+	// reject corner offsets of the children are derived from dxdy when the triangle is rasterized
+	struct alignas(64) Triangle
+	{
+		// edge function value at reject corner of block (0, 0), in full precision
 		int64_t rc_hp[3];
 		// edge function delta in x/y direction
 		vec2i dxdy[3];
-		// top-left fill rule bias
-		vec3i bias;
-		// low bits of full precision edge function value
-		vec3f tail;
-		// pixcel center offset
-		vec3i center_offset;
+		// bounding box in pixels {min_x, min_y, max_x, max_y}
+		int16_t bounding[4];
+		// reject corner offset of the first child in each LOD below the block, i.e. (rc_hp >> triangle_lod_shift(lod)) & 3
+		uint8_t lod_offset[3][SPW_LOD_MAX];
 	};
+	static_assert(sizeof(Triangle) == 64, "Triangle should fit in a cache line");
 	
 	template<class T>
 	class CMemoryArena
@@ -486,11 +498,16 @@ namespace wyc
 		int size;
 		int shift;
 		int lod;
-		vec3i reject;
+		// index of the node in its LOD, in the swizzled order of the block
+		unsigned index;
+		// edge function values at reject corner, they are exact so a block or tile can be rasterized from its local origin
+		int64_t reject[3];
 	};
 	
 	typedef CMemoryArena<TileBlock> BlockArena;
 	
+	// w/h: render target size in blocks
+	// x/y: position of the first block, in blocks
 	struct RenderTarget
 	{
 		char *storage;
@@ -545,17 +562,78 @@ namespace wyc
 	};
 
 	void setup_triangle(Triangle *edge, const vec2f *vf0, const vec2f *vf1, const vec2f *vf2);
+
+	// vertex positions of a batch of triangles in SoA layout, vertex k of triangle i is {x[k][i], y[k][i]}
+	struct TriangleBatch
+	{
+		alignas(16) float x[3][SPW_SETUP_BATCH];
+		alignas(16) float y[3][SPW_SETUP_BATCH];
+	};
+	// setup the first "count" triangles of batch, with the same result as setup_triangle
+	// triangles are set up 4 at a time with SSE, edge directions are selected by masks instead of branches
+	void setup_triangles(Triangle *prims, const TriangleBatch *batch, unsigned count);
 	// search all blocks covered by triangle
+	// if the bounding box of triangle is inside a single 4x4 tile or 16x16 node, that node is queued instead of blocks
 	unsigned scan_block(RenderTarget *rt, const Triangle *tri, BlockArena *arena, TileQueue *full_blocks, TileQueue *partial_blocks);
-	// search all full/partial tiles covered by triangle
-	void scan_tile(const Triangle *prim, TileBlock *block, BlockArena *arena, TileQueue *full_tiles, TileQueue *partial_tiles);
-	// divide full-covered blocks into tiles
-	void split_tile(const Triangle *prim, BlockArena *arena, TileBlock *block, TileQueue *full_tiles);
 
-	typedef void (*PixelShader) (char *dst, const vec3f &w);
+	// coverage of a 4x4 tile
+	// mask: bit i is set if pixel i is inside of triangle
+	// w: normalized barycentric coordinates of the 16 pixels in SoA layout,
+	//    pixels outside of triangle are calculated as well, so quads can get their derivatives
+	// with 4x multi-sampling, bit i of sample_mask[s] is set if sample s of pixel i is inside of triangle,
+	//    and mask is the union of them, so a pixel is shaded once if any of its samples is covered
+	struct TileCoverage
+	{
+		alignas(64) float w[3][16];
+		unsigned mask;
+		unsigned sample_mask[SPW_MSAA_SAMPLES];
+	};
+
+	// sample positions of 4x rotated grid multi-sampling, in 1/8 pixel relative to pixel center
+	constexpr int msaa_sample_offset[SPW_MSAA_SAMPLES][2] = {
+		{ -1, -3 }, { 3, -1 }, { -3, 1 }, { 1, 3 },
+	};
+
+	// evaluate coverage of a 4x4 tile, using the best SIMD kernel supported by cpu
+	void tile_coverage(const Triangle *prim, const TileBlock *tile, TileCoverage *coverage);
+	// evaluate coverage of a 4x4 tile with 4x multi-sampling, weights are still at pixel center
+	void tile_sample_coverage(const Triangle *prim, const TileBlock *tile, TileCoverage *coverage);
+	// name of the current coverage kernel: "avx512", "avx2", "sse4" or "scalar"
+	const char* tile_coverage_kernel();
+	// force a coverage kernel, return false if it's not supported
+	bool set_tile_coverage_kernel(const char *name);
+
+	// shade a 4x4 tile, pixel i is at (dst + i * pixel_size)
+	typedef void (*TileShader) (void *ctx, char *dst, const TileCoverage &coverage);
 	// draw partial-covered tile
-	void draw_tile(const Triangle *prim, TileBlock *tile, PixelShader shader);
+	void draw_tile(const Triangle *prim, TileBlock *tile, TileShader shader, void *ctx);
 	// draw full-covered tile
-	void fill_tile(const Triangle *prim, TileBlock *tile, PixelShader shader);
+	void fill_tile(const Triangle *prim, TileBlock *tile, TileShader shader, void *ctx);
+	// coarse depth of a block: min/max depth of the block, its 16x16 tiles and its 4x4 tiles
+	// node i at LOD n is stored at [block_depth_offset(n) + i], and its children are nodes [i*16, i*16+16) at LOD n+1,
+	// so nodes are in the same order as the swizzled storage
+	struct BlockDepth
+	{
+		float zmin[1 + 16 + 256];
+		float zmax[1 + 16 + 256];
+	};
+
+	constexpr unsigned block_depth_offset(int lod)
+	{
+		return lod == 0 ? 0 : block_depth_offset(lod - 1) * 16 + 1;
+	}
+
+	// build coarse depth from the swizzled 64x64 depth buffer of a block
+	// with multi-sampling, each tile stores "sample_count" planes of its 16 pixels
+	void init_block_depth(BlockDepth *coarse, const float *depth, unsigned sample_count = 1);
+	// update coarse depth after tile is written, "depth" points to the 16 pixels (of each sample) of the tile
+	void update_block_depth(BlockDepth *coarse, unsigned tile, const float *depth, unsigned sample_count = 1);
+
+	// draw all tiles of a block (or the smaller node) found by scan_block, "full" is set if it's in the full-covered queue
+	// it descends through the LODs with an explicit stack, covered children of each level are kept as bitmasks
+	// if coarse depth is provided, nodes whose farthest depth is not greater than "zmin" of triangle are skipped
+	// if "multisample" is set, tiles get the coverage of tile_sample_coverage
+	void rasterize_block(const Triangle *prim, const TileBlock *block, bool full, TileShader shader, void *ctx,
+		const BlockDepth *coarse = nullptr, float zmin = 0, bool multisample = false);
 
 } // namespace wyc
@@ -16,6 +16,20 @@ inline unsigned align_down(unsigned x, unsigned align)
 	return x & ~(align - 1);
 }
 
+// index of pixel (x, y) in a 64x64 swizzled block
+// 4x4 pixels in 16x16 tiles in 64x64 block: y5y4x5x4y3y2x3x2y1y0x1x0
+inline unsigned swizzle_block_index(unsigned x, unsigned y)
+{
+	return (x & 0x03) | ((x & 0x0c) << 2) | ((x & 0x30) << 4)
+		| ((y & 0x03) << 2) | ((y & 0x0c) << 4) | ((y & 0x30) << 6);
+}
+
+// index of pixel (x, y) in a swizzled texture, "w" is the texture width padded to 64 boundaries
+inline unsigned swizzle_index(unsigned x, unsigned y, unsigned w)
+{
+	return (((y >> 6) * (w >> 6) + (x >> 6)) << 12) + swizzle_block_index(x, y);
+}
+
 // swizzle sw*sh, 32bpp texel data from "src" to "dst" at position (dx, dy)
 // "dst" is a 2D texture of dw*dh size, "dw" and "dh" should be padded to 64 boundaries
 // "spitch" is the distance between rows in "src" image, in units of 32bpp texels
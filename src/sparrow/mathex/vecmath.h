@@ -1,5 +1,6 @@
 #pragma once
 #include <cmath>
+#include <cstdint>
 #include <ImathPlatform.h>
 #include <ImathForward.h>
 
@@ -11,6 +12,7 @@ namespace wyc
 	typedef Imath::Vec2<int> vec2i;
 	typedef Imath::Vec3<int> vec3i;
 	typedef Imath::Vec4<int> vec4i;
+	typedef Imath::Vec4<int64_t> vec4l;
 	typedef Imath::Matrix33<float> mat3f;
 	typedef Imath::Matrix44<float> mat4f;
 	typedef Imath::Matrix33<int> mat3i;
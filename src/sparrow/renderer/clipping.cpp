@@ -261,9 +261,10 @@ namespace wyc
 		return vertex_out;
 	}
 
+	static constexpr float w_epsilon = 0.0001f;
+
 	void clip_polygon_stream(std::vector<float> &vertices, std::vector<unsigned> &indices_in, std::vector<unsigned> &indices_out, unsigned stride)
 	{
-		constexpr float w_epsilon = 0.0001f;
 		// pos = {x, y, z, w}
 		float pdot, dot;
 		unsigned prev_i;
@@ -342,4 +343,16 @@ namespace wyc
 		}
 	}
 
+	bool inside_guard_band(const float *v0, const float *v1, const float *v2, const vec2f &guard_band)
+	{
+		// pos = {x, y, z, w}
+		for (const float *v : { v0, v1, v2 })
+		{
+			float w = v[3];
+			if (w < w_epsilon || std::abs(v[0]) > guard_band.x * w || std::abs(v[1]) > guard_band.y * w || std::abs(v[2]) > w)
+				return false;
+		}
+		return true;
+	}
+
 } // namespace wyc
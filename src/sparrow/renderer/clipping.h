@@ -57,5 +57,10 @@ namespace wyc
 	// stride: vertex stride in float component
 	void clip_polygon_stream(std::vector<float> &vertices, std::vector<unsigned> &indices_in, std::vector<unsigned> &indices_out, unsigned stride);
 
+	// Check if triangle {v0, v1, v2} in homogeneous clipping space is in front of the near plane,
+	// inside the depth range and inside the guard band, in which case it can skip clipping
+	// guard_band: guard band extent relative to the viewport in NDC, i.e. |x| <= guard_band.x * w
+	bool inside_guard_band(const float *v0, const float *v1, const float *v2, const vec2f &guard_band);
+
 	bool clip_line(vec2f &v0, vec2f &v1, const box2f &clip_window);
 } // namespace wyc
\ No newline at end of file
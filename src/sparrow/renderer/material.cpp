@@ -1,4 +1,5 @@
 #include "material.h"
+#include <cassert>
 
 namespace wyc
 {
@@ -15,6 +16,47 @@ namespace wyc
 	{
 	}
 
+	void CMaterial::vertex_shader_batch(const float * const *attribs, unsigned attrib_count, unsigned vertex_stride,
+		const unsigned *indices, unsigned count, float *vertex_out, unsigned out_stride, CShaderContext *ctx) const
+	{
+		constexpr unsigned max_attrib_count = 16;
+		assert(attrib_count <= max_attrib_count);
+		const float *vertex_in[max_attrib_count];
+		for (unsigned i = 0; i < count; ++i, vertex_out += out_stride)
+		{
+			auto offset = indices[i] * vertex_stride;
+			for (unsigned j = 0; j < attrib_count; ++j)
+				vertex_in[j] = attribs[j] + offset;
+			vertex_shader(vertex_in, vertex_out, ctx);
+		}
+	}
+
+	unsigned CMaterial::fragment_shader_quad(const float *frag_in, unsigned stride, unsigned mask, color4f *frag_color, CShaderContext *ctx) const
+	{
+		unsigned written = 0;
+		for (int i = 0; i < 4; ++i)
+		{
+			if ((mask & (1 << i)) && fragment_shader(frag_in + i * stride, frag_color[i], ctx))
+				written |= 1 << i;
+		}
+		return written;
+	}
+
+	unsigned CMaterial::fragment_shader_tile(const float *frag_in, unsigned stride, unsigned mask, color4f *frag_color, CShaderContext *ctx) const
+	{
+		unsigned written = 0;
+		for (int q = 0; q < 4; ++q, mask >>= 4, frag_in += stride * 4, frag_color += 4)
+		{
+			if (!(mask & 0xF))
+				continue;
+			// derivatives are taken inside of the quad
+			if (ctx)
+				ctx->vertex_quad = frag_in;
+			written |= fragment_shader_quad(frag_in, stride, mask & 0xF, frag_color, ctx) << (q * 4);
+		}
+		return written;
+	}
+
 	const CUniform * CMaterial::find_uniform(const std::string & name) const
 	{
 		const auto &uniform_map = get_uniform_define();
@@ -106,6 +106,8 @@ namespace wyc
 
 	enum MATERIAL_FEATURE {
 		MF_NO_PERSPECTIVE_CORRECTION = 1,
+		// fragment shader calls ddx/ddy, so pixels of the quad are interpolated even if they are not shaded
+		MF_QUAD_DERIVATIVE = 2,
 	};
 
 	class CMaterial
@@ -118,6 +120,17 @@ namespace wyc
 		virtual void vertex_shader(const void *vertex_in, void *vertex_out, CShaderContext *ctx = 0) const {};
 		virtual void geometry_shader(void *triangles) const {}
 		virtual bool fragment_shader(const void *frag_in, color4f &frag_color, CShaderContext *ctx = 0) const { return false; };
+		// batch shader interface: one virtual call shades a group of vertices or pixels, so shaders can be vectorized
+		// the default implementations forward to vertex_shader/fragment_shader one by one
+		// shade "count" vertices, attribute j of vertex i is read from stream (attribs[j] + indices[i] * vertex_stride)
+		// vertex i is written to (vertex_out + i * out_stride)
+		virtual void vertex_shader_batch(const float * const *attribs, unsigned attrib_count, unsigned vertex_stride,
+			const unsigned *indices, unsigned count, float *vertex_out, unsigned out_stride, CShaderContext *ctx = 0) const;
+		// shade a 2x2 quad, pixel i is read from (frag_in + i * stride) if bit i of mask is set
+		// return the mask of pixels written to frag_color
+		virtual unsigned fragment_shader_quad(const float *frag_in, unsigned stride, unsigned mask, color4f *frag_color, CShaderContext *ctx = 0) const;
+		// shade a 4x4 tile as 4 quads, pixels of quad q are [q * 4, q * 4 + 4) in frag_in, mask and frag_color
+		virtual unsigned fragment_shader_tile(const float *frag_in, unsigned stride, unsigned mask, color4f *frag_color, CShaderContext *ctx = 0) const;
 		unsigned feature() const {
 			return m_feature;
 		}
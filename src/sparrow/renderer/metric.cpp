@@ -17,8 +17,17 @@ namespace wyc
 	{
 		m_timers.resize(SPW_TIMER_COUNT, 0.0f);
 		m_counters.resize(SPW_COUNTER_COUNT, 0);
+		m_worker_times.clear();
 	}
 	
+	void CSpwMetric::worker_time(unsigned worker, float busy, float idle)
+	{
+		if (worker >= m_worker_times.size())
+			m_worker_times.resize(worker + 1, { 0.0f, 0.0f });
+		m_worker_times[worker].first += busy;
+		m_worker_times[worker].second += idle;
+	}
+
 	void CSpwMetric::time_beg(SPW_TIMER tid)
 	{
 		auto now = std::chrono::steady_clock::now();
@@ -41,12 +50,24 @@ namespace wyc
 		log_info("| viewport culling: %d", my_counter(VIEWPORT_CULLING_COUNT));
 		log_info("| backface culling: %d", my_counter(BACKFACE_CULLING_COUNT));
 		log_info("| depth culling: %d", my_counter(DEPTH_CULLING_COUNT));
+		log_info("| coarse depth culling: %d", my_counter(HIZ_CULLING_COUNT));
+		log_info("| skipped interpolation: %d pixels", my_counter(INTERP_SKIPPED_COUNT));
 		log_info("| triangles count: %d", my_counter(TRIANGLE_COUNT));
 		log_info("| vertex count: %d", my_counter(VERTEX_COUNT));
+		log_info("| vertex cache: %d hit, %d miss", my_counter(VERTEX_CACHE_HIT_COUNT), my_counter(VERTEX_CACHE_MISS_COUNT));
+		unsigned clipping_total = my_counter(GUARD_BAND_COUNT) + my_counter(CLIPPING_COUNT);
+		log_info("| polygon clipping: %d of %d triangles (%.2f%%)", my_counter(CLIPPING_COUNT), clipping_total,
+			clipping_total ? my_counter(CLIPPING_COUNT) * 100.0f / clipping_total : 0.0f);
 		log_info("| pixel count: %d", my_counter(PIXEL_COUNT));
+		log_info("| bin entries: %d", my_counter(BIN_ENTRY_COUNT));
+		log_info("| occupied bins: %d", my_counter(BIN_OCCUPIED_COUNT));
+		log_info("| max bin occupancy: %d", my_counter(BIN_MAX_OCCUPANCY));
+		log_info("| bin pool: %d KB", my_counter(BIN_POOL_SIZE) >> 10);
 		log_info("| time used by vs: %.2f ms", my_timer(VERTEX_SHADER));
 		log_info("| time used by ps: %.2f ms", my_timer(PIXEL_SHADER));
 		log_info("| time used by draw: %.2f ms", my_timer(DRAW_TRIANGLE));
+		for (size_t i = 0; i < m_worker_times.size(); ++i)
+			log_info("| worker %d: busy %.2f ms, idle %.2f ms", int(i), m_worker_times[i].first, m_worker_times[i].second);
 		log_info(splitter);
 	}
 	
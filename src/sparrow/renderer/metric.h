@@ -23,6 +23,16 @@ namespace wyc
 		VIEWPORT_CULLING_COUNT,
 		BACKFACE_CULLING_COUNT,
 		DEPTH_CULLING_COUNT,
+		HIZ_CULLING_COUNT,
+		INTERP_SKIPPED_COUNT,
+		VERTEX_CACHE_HIT_COUNT,
+		VERTEX_CACHE_MISS_COUNT,
+		GUARD_BAND_COUNT,
+		CLIPPING_COUNT,
+		BIN_ENTRY_COUNT,
+		BIN_OCCUPIED_COUNT,
+		BIN_MAX_OCCUPANCY,
+		BIN_POOL_SIZE,
 		
 		SPW_COUNTER_COUNT
 	};
@@ -40,6 +50,15 @@ namespace wyc
 		inline void count(SPW_COUNTER tid) {
 			m_counters[tid] += 1;
 		}
+		inline void count(SPW_COUNTER tid, unsigned n) {
+			m_counters[tid] += n;
+		}
+		inline void count_max(SPW_COUNTER tid, unsigned n) {
+			if(m_counters[tid] < n)
+				m_counters[tid] = n;
+		}
+		// accumulate busy and idle time (in milliseconds) of a worker thread
+		void worker_time(unsigned worker, float busy, float idle);
 		void report();
 		
 	private:
@@ -48,6 +67,7 @@ namespace wyc
 		std::vector<std::pair<unsigned, time_point_t>> m_timer_stack;
 		std::vector<float> m_timers;
 		std::vector<unsigned> m_counters;
+		std::vector<std::pair<float, float>> m_worker_times;
 	};
 	
 	class CSpwMetricTimer
@@ -93,11 +113,24 @@ namespace wyc
 #define VIEWPORT_CULLING
 #define BACKFACE_CULLING
 #define DEPTH_CULLING
+#define HIZ_CULLING
+#define INTERP_SKIPPED(n)
+#define VERTEX_CACHE_HIT(n)
+#define VERTEX_CACHE_MISS(n)
+#define GUARD_BAND_PASSED
+#define POLYGON_CLIPPED
+#define BIN_ENTRY(n)
+#define BIN_OCCUPIED(n)
+#define BIN_MAX_OCCUPANCY(n)
+#define BIN_POOL_SIZE(n)
+#define WORKER_TIME(worker, busy, idle)
 
 #else // !NO_PERF
 
 #define _NEW_TIMER(name) wyc::CSpwMetricTimer __TIMER_##name##__(wyc::SPW_TIMER::name);
 #define _INC_COUNTER(name) {wyc::CSpwMetric::singleton()->count(name);}
+#define _ADD_COUNTER(name, n) {wyc::CSpwMetric::singleton()->count(name, unsigned(n));}
+#define _MAX_COUNTER(name, n) {wyc::CSpwMetric::singleton()->count_max(name, unsigned(n));}
 
 // timer
 #define TIME_VERTEX_SHADER _NEW_TIMER(VERTEX_SHADER)
@@ -111,6 +144,17 @@ namespace wyc
 #define VIEWPORT_CULLING _INC_COUNTER(VIEWPORT_CULLING_COUNT)
 #define BACKFACE_CULLING _INC_COUNTER(BACKFACE_CULLING_COUNT)
 #define DEPTH_CULLING _INC_COUNTER(DEPTH_CULLING_COUNT)
+#define HIZ_CULLING _INC_COUNTER(HIZ_CULLING_COUNT)
+#define INTERP_SKIPPED(n) _ADD_COUNTER(INTERP_SKIPPED_COUNT, n)
+#define VERTEX_CACHE_HIT(n) _ADD_COUNTER(VERTEX_CACHE_HIT_COUNT, n)
+#define VERTEX_CACHE_MISS(n) _ADD_COUNTER(VERTEX_CACHE_MISS_COUNT, n)
+#define GUARD_BAND_PASSED _INC_COUNTER(GUARD_BAND_COUNT)
+#define POLYGON_CLIPPED _INC_COUNTER(CLIPPING_COUNT)
+#define BIN_ENTRY(n) _ADD_COUNTER(BIN_ENTRY_COUNT, n)
+#define BIN_OCCUPIED(n) _ADD_COUNTER(BIN_OCCUPIED_COUNT, n)
+#define BIN_MAX_OCCUPANCY(n) _MAX_COUNTER(BIN_MAX_OCCUPANCY, n)
+#define BIN_POOL_SIZE(n) _MAX_COUNTER(BIN_POOL_SIZE, n)
+#define WORKER_TIME(worker, busy, idle) {wyc::CSpwMetric::singleton()->worker_time(worker, busy, idle);}
 
 #endif // NO_PEF
 
@@ -0,0 +1,277 @@
+#include "pixel_format.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <emmintrin.h>
+
+namespace wyc
+{
+	unsigned get_color_size(EPixelFormat format)
+	{
+		switch (format)
+		{
+		case SPW_COLOR_R8G8B8A8:
+		case SPW_COLOR_R8G8B8A8_SRGB:
+			return 4;
+		case SPW_COLOR_RGBA_F16:
+			return 8;
+		case SPW_COLOR_RGBA_F32:
+			return 16;
+		default:
+			return 0;
+		}
+	}
+
+	// linear to sRGB, indexed by 12-bit linear value
+	// 12 bits keep the error of dark values below 1 step of 8-bit sRGB
+	constexpr unsigned SRGB_LUT_BITS = 12;
+	constexpr unsigned SRGB_LUT_SIZE = 1 << SRGB_LUT_BITS;
+
+	struct SrgbTable
+	{
+		uint8_t encode[SRGB_LUT_SIZE];
+		float decode[256];
+		// 8-bit linear to 8-bit sRGB
+		uint8_t encode8[256];
+
+		SrgbTable()
+		{
+			for (unsigned i = 0; i < SRGB_LUT_SIZE; ++i)
+			{
+				float c = float(i) / (SRGB_LUT_SIZE - 1);
+				c = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1 / 2.4f) - 0.055f;
+				encode[i] = uint8_t(c * 255 + 0.5f);
+			}
+			for (unsigned i = 0; i < 256; ++i)
+			{
+				float c = i / 255.0f;
+				decode[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+				encode8[i] = encode[(i * (SRGB_LUT_SIZE - 1) + 127) / 255];
+			}
+		}
+	};
+
+	static const SrgbTable& get_srgb_table()
+	{
+		static SrgbTable s_table;
+		return s_table;
+	}
+
+	// clamp color to [0, 1] and scale it to integer, NaN is clamped to 0
+	static inline __m128i quantize(const color4f &c, __m128 scale)
+	{
+		__m128 v = _mm_loadu_ps(&c.r);
+		v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+		return _mm_cvtps_epi32(_mm_mul_ps(v, scale));
+	}
+
+	// float to half with round-to-nearest-even, each half is in the low 16 bits of 32-bit lane
+	// overflow goes to infinity, and NaN is kept
+	static inline __m128i float_to_half(__m128 f)
+	{
+		const __m128i c_f16max = _mm_set1_epi32((127 + 16) << 23);
+		const __m128i c_nanbit = _mm_set1_epi32(0x200);
+		const __m128i c_infinity = _mm_set1_epi32(0x7c00);
+		const __m128i c_min_normal = _mm_set1_epi32((127 - 14) << 23);
+		const __m128i c_subnorm_magic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+		const __m128i c_normal_bias = _mm_set1_epi32(0xfff - ((127 - 15) << 23));
+		__m128 sign = _mm_and_ps(f, _mm_castsi128_ps(_mm_set1_epi32(int(0x80000000u))));
+		__m128 absf = _mm_xor_ps(f, sign);
+		__m128i absi = _mm_castps_si128(absf);
+		__m128i is_nan = _mm_castps_si128(_mm_cmpunord_ps(absf, absf));
+		__m128i is_regular = _mm_cmpgt_epi32(c_f16max, absi);
+		__m128i inf_or_nan = _mm_or_si128(_mm_and_si128(is_nan, c_nanbit), c_infinity);
+		__m128i is_subnormal = _mm_cmpgt_epi32(c_min_normal, absi);
+		// subnormal: magic add rounds the mantissa
+		__m128i subnormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(absf, _mm_castsi128_ps(c_subnorm_magic))), c_subnorm_magic);
+		// normal: rebias exponent and round to nearest even
+		__m128i odd = _mm_srai_epi32(_mm_slli_epi32(absi, 31 - 13), 31);
+		__m128i normal = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(absi, c_normal_bias), odd), 13);
+		__m128i finite = _mm_or_si128(_mm_and_si128(is_subnormal, subnormal), _mm_andnot_si128(is_subnormal, normal));
+		__m128i h = _mm_or_si128(_mm_and_si128(is_regular, finite), _mm_andnot_si128(is_regular, inf_or_nan));
+		// sign is extended to the high 16 bits, so the result can be packed with signed saturation
+		return _mm_or_si128(h, _mm_srai_epi32(_mm_castps_si128(sign), 16));
+	}
+
+	// half in the low 16 bits of 32-bit lane to float
+	static inline __m128 half_to_float(__m128i h)
+	{
+		const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23));
+		const __m128 infnan_exp = _mm_castsi128_ps(_mm_set1_epi32(255 << 23));
+		__m128i expmant = _mm_and_si128(h, _mm_set1_epi32(0x7fff));
+		__m128i sign = _mm_slli_epi32(_mm_xor_si128(h, expmant), 16);
+		// scaling by magic rebiases the exponent, and normalizes subnormals
+		__m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expmant, 13)), magic);
+		__m128i is_infnan = _mm_cmpgt_epi32(expmant, _mm_set1_epi32(0x7bff));
+		__m128 infnan = _mm_and_ps(_mm_castsi128_ps(is_infnan), infnan_exp);
+		return _mm_or_ps(scaled, _mm_or_ps(_mm_castsi128_ps(sign), infnan));
+	}
+
+	static void pack_rgba8(uint32_t *dst, const color4f *src, unsigned count)
+	{
+		const __m128 scale = _mm_set1_ps(255.0f);
+		unsigned i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128i c01 = _mm_packs_epi32(quantize(src[i], scale), quantize(src[i + 1], scale));
+			__m128i c23 = _mm_packs_epi32(quantize(src[i + 2], scale), quantize(src[i + 3], scale));
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(c01, c23));
+		}
+		for (; i < count; ++i)
+		{
+			__m128i c = _mm_packs_epi32(quantize(src[i], scale), _mm_setzero_si128());
+			dst[i] = uint32_t(_mm_cvtsi128_si32(_mm_packus_epi16(c, c)));
+		}
+	}
+
+	static void pack_srgb8(uint32_t *dst, const color4f *src, unsigned count)
+	{
+		const uint8_t *lut = get_srgb_table().encode;
+		const __m128 scale = _mm_set1_ps(float(SRGB_LUT_SIZE - 1));
+		alignas(16) int32_t index[4];
+		for (unsigned i = 0; i < count; ++i)
+		{
+			_mm_store_si128((__m128i*)index, quantize(src[i], scale));
+			// alpha is linear
+			uint32_t alpha = (uint32_t(index[3]) * 255 + (SRGB_LUT_SIZE - 1) / 2) / (SRGB_LUT_SIZE - 1);
+			dst[i] = lut[index[0]] | (lut[index[1]] << 8) | (lut[index[2]] << 16) | (alpha << 24);
+		}
+	}
+
+	static void pack_rgba16f(uint16_t *dst, const color4f *src, unsigned count)
+	{
+		unsigned i = 0;
+		for (; i + 2 <= count; i += 2, dst += 8)
+		{
+			__m128i h0 = float_to_half(_mm_loadu_ps(&src[i].r));
+			__m128i h1 = float_to_half(_mm_loadu_ps(&src[i + 1].r));
+			_mm_storeu_si128((__m128i*)dst, _mm_packs_epi32(h0, h1));
+		}
+		if (i < count)
+		{
+			__m128i h = float_to_half(_mm_loadu_ps(&src[i].r));
+			_mm_storel_epi64((__m128i*)dst, _mm_packs_epi32(h, h));
+		}
+	}
+
+	void pack_color(void *dst, const color4f *src, unsigned count, EPixelFormat format)
+	{
+		switch (format)
+		{
+		case SPW_COLOR_R8G8B8A8:
+			pack_rgba8((uint32_t*)dst, src, count);
+			break;
+		case SPW_COLOR_R8G8B8A8_SRGB:
+			pack_srgb8((uint32_t*)dst, src, count);
+			break;
+		case SPW_COLOR_RGBA_F16:
+			pack_rgba16f((uint16_t*)dst, src, count);
+			break;
+		case SPW_COLOR_RGBA_F32:
+			memcpy(dst, src, count * sizeof(color4f));
+			break;
+		default:
+			assert(0 && "invalid color format");
+			break;
+		}
+	}
+
+	static void unpack_rgba8(color4f *dst, const uint32_t *src, unsigned count)
+	{
+		const __m128 scale = _mm_set1_ps(1 / 255.0f);
+		const __m128i zero = _mm_setzero_si128();
+		for (unsigned i = 0; i < count; ++i)
+		{
+			__m128i c = _mm_cvtsi32_si128(int(src[i]));
+			c = _mm_unpacklo_epi16(_mm_unpacklo_epi8(c, zero), zero);
+			_mm_storeu_ps(&dst[i].r, _mm_mul_ps(_mm_cvtepi32_ps(c), scale));
+		}
+	}
+
+	static void unpack_srgb8(color4f *dst, const uint32_t *src, unsigned count)
+	{
+		const float *lut = get_srgb_table().decode;
+		for (unsigned i = 0; i < count; ++i)
+		{
+			uint32_t c = src[i];
+			dst[i] = color4f(lut[c & 0xFF], lut[(c >> 8) & 0xFF], lut[(c >> 16) & 0xFF], (c >> 24) / 255.0f);
+		}
+	}
+
+	static void unpack_rgba16f(color4f *dst, const uint16_t *src, unsigned count)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		for (unsigned i = 0; i < count; ++i, src += 4)
+		{
+			__m128i h = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)src), zero);
+			_mm_storeu_ps(&dst[i].r, half_to_float(h));
+		}
+	}
+
+	void unpack_color(color4f *dst, const void *src, unsigned count, EPixelFormat format)
+	{
+		switch (format)
+		{
+		case SPW_COLOR_R8G8B8A8:
+			unpack_rgba8(dst, (const uint32_t*)src, count);
+			break;
+		case SPW_COLOR_R8G8B8A8_SRGB:
+			unpack_srgb8(dst, (const uint32_t*)src, count);
+			break;
+		case SPW_COLOR_RGBA_F16:
+			unpack_rgba16f(dst, (const uint16_t*)src, count);
+			break;
+		case SPW_COLOR_RGBA_F32:
+			memcpy(dst, src, count * sizeof(color4f));
+			break;
+		default:
+			assert(0 && "invalid color format");
+			break;
+		}
+	}
+
+	static void encode_rgba8(uint32_t *dst, const uint32_t *src, unsigned count)
+	{
+		const uint8_t *lut = get_srgb_table().encode8;
+		for (unsigned i = 0; i < count; ++i)
+		{
+			uint32_t c = src[i];
+			dst[i] = lut[c & 0xFF] | (lut[(c >> 8) & 0xFF] << 8) | (lut[(c >> 16) & 0xFF] << 16) | (c & 0xFF000000);
+		}
+	}
+
+	void encode_srgb8(uint32_t *dst, const void *src, unsigned count, EPixelFormat format)
+	{
+		switch (format)
+		{
+		case SPW_COLOR_R8G8B8A8:
+			encode_rgba8(dst, (const uint32_t*)src, count);
+			break;
+		case SPW_COLOR_R8G8B8A8_SRGB:
+			memcpy(dst, src, count * sizeof(uint32_t));
+			break;
+		case SPW_COLOR_RGBA_F16:
+		{
+			// half floats are expanded by chunks which stay in L1
+			constexpr unsigned chunk = 64;
+			color4f colors[chunk];
+			const uint16_t *half = (const uint16_t*)src;
+			for (unsigned i = 0; i < count; i += chunk)
+			{
+				unsigned n = std::min(chunk, count - i);
+				unpack_rgba16f(colors, half + i * 4, n);
+				pack_srgb8(dst + i, colors, n);
+			}
+			break;
+		}
+		case SPW_COLOR_RGBA_F32:
+			pack_srgb8(dst, (const color4f*)src, count);
+			break;
+		default:
+			assert(0 && "invalid color format");
+			break;
+		}
+	}
+
+} // namespace wyc
@@ -0,0 +1,20 @@
+#pragma once
+#include "render_target.h"
+#include "vecmath.h"
+
+namespace wyc
+{
+	// bytes per pixel of color format, 0 if it's not a color format
+	unsigned get_color_size(EPixelFormat format);
+
+	// convert "count" colors to pixels of color format with SIMD
+	// RGBA8 values are clamped to [0, 1], sRGB format encodes RGB channels with a lookup table
+	void pack_color(void *dst, const color4f *src, unsigned count, EPixelFormat format);
+
+	// convert "count" pixels of color format to colors, sRGB format is decoded to linear space
+	void unpack_color(color4f *dst, const void *src, unsigned count, EPixelFormat format);
+
+	// convert "count" pixels of color format to 8-bit sRGB for presentation, alpha is kept linear
+	void encode_srgb8(uint32_t *dst, const void *src, unsigned count, EPixelFormat format);
+
+} // namespace wyc
@@ -13,6 +13,9 @@ namespace wyc
 		SPW_COLOR_SHIFT = 0,
 		SPW_COLOR_R8G8B8A8 = 1,
 		SPW_COLOR_RGBA_F32 = 2,
+		// sRGB encoded RGB and linear alpha
+		SPW_COLOR_R8G8B8A8_SRGB = 3,
+		SPW_COLOR_RGBA_F16 = 4,
 
 		// depth buffer
 		SPW_DEPTH_MASK = 0x300,
@@ -25,6 +28,16 @@ namespace wyc
 		SPW_STENCIL_SHIFT = 10,
 		SPW_STENCIL_8 = 0x400,
 		SPW_STENCIL_16 = 0x800,
+
+		// multi-sampling
+		SPW_MSAA_MASK = 0x3000,
+		SPW_MSAA_SHIFT = 12,
+		SPW_MSAA_4X = 0x1000,
+
+		// pixel layout of color and depth
+		SPW_LAYOUT_MASK = 0x4000,
+		SPW_LAYOUT_SHIFT = 14,
+		SPW_LAYOUT_SWIZZLE = 0x4000,
 	};
 
 	inline EPixelFormat get_color_format(unsigned format)
@@ -42,6 +55,16 @@ namespace wyc
 		return EPixelFormat(format & SPW_STENCIL_MASK);
 	}
 
+	inline unsigned get_sample_count(unsigned format)
+	{
+		return (format & SPW_MSAA_MASK) == SPW_MSAA_4X ? 4 : 1;
+	}
+
+	inline bool is_swizzled_format(unsigned format)
+	{
+		return (format & SPW_LAYOUT_MASK) == SPW_LAYOUT_SWIZZLE;
+	}
+
 	class CRenderTarget
 	{
 	public:
@@ -1,47 +1,189 @@
 #include "sampler.h"
-#include "floatmath.h"
 #include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <emmintrin.h>
+#include "floatmath.h"
+#include "spw_tile.h"
 
 namespace wyc
 {
-	color4f bilinear_filter(const CImage *image, const vec2f &uv)
+	bool SwizzledTexture::create(const CImage *image)
+	{
+		width = image->width();
+		height = image->height();
+		if (!width || !height || !image->buffer())
+			return false;
+		pitch = align_up(width, 64);
+		unsigned rows = align_up(height, 64);
+		storage.resize(pitch * rows / 4);
+		is_pow2 = !(width & (width - 1)) && !(height & (height - 1));
+		uint32_t *dst = (uint32_t*)storage.data();
+		const uint32_t *src = (const uint32_t*)image->buffer();
+		unsigned spitch = image->pitch() / sizeof(uint32_t);
+		// 4x4 tiles are converted by SIMD, and the margins by texel
+		unsigned w4 = align_down(width, 4), h4 = align_down(height, 4);
+		if (w4 && h4)
+			swizzle_32bpp_fast(dst, pitch, src, w4, h4, spitch);
+		if (w4 < width)
+			swizzle_32bpp(dst, w4, 0, pitch, rows, src + w4, width - w4, height, spitch);
+		if (h4 < height)
+			swizzle_32bpp(dst, 0, h4, pitch, rows, src + h4 * spitch, w4, height - h4, spitch);
+		return true;
+	}
+
+	static inline __m128 unpack_texel(uint32_t texel)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		__m128i c = _mm_cvtsi32_si128(int(texel));
+		c = _mm_unpacklo_epi16(_mm_unpacklo_epi8(c, zero), zero);
+		return _mm_cvtepi32_ps(c);
+	}
+
+	color4f bilinear_filter(const SwizzledTexture &tex, const vec2f &uv)
 	{
-		float u, v, s, t;
-		auto img_w = image->width();
-		auto img_h = image->height();
-		u = uv.x * img_w;
-		v = uv.y * img_h;
+		float u, v;
+		u = uv.x * tex.width;
+		v = uv.y * tex.height;
 
 		int x0, y0, x1, y1;
 		x0 = fast_floor(u);
 		y0 = fast_floor(v);
 		u -= x0;
 		v -= y0;
+		x1 = x0 + 1;
+		y1 = y0 + 1;
+		tex.wrap(x0, y0);
+		tex.wrap(x1, y1);
+
+		const uint32_t *texels = tex.texels();
+		__m128 c1 = unpack_texel(texels[swizzle_index(x0, y0, tex.pitch)]);
+		__m128 c2 = unpack_texel(texels[swizzle_index(x1, y0, tex.pitch)]);
+		__m128 c3 = unpack_texel(texels[swizzle_index(x1, y1, tex.pitch)]);
+		__m128 c4 = unpack_texel(texels[swizzle_index(x0, y1, tex.pitch)]);
+
+		__m128 s = _mm_set1_ps(u), t = _mm_set1_ps(v);
+		__m128 top = _mm_add_ps(c1, _mm_mul_ps(_mm_sub_ps(c2, c1), s));
+		__m128 bottom = _mm_add_ps(c4, _mm_mul_ps(_mm_sub_ps(c3, c4), s));
+		__m128 c = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), t));
+		color4f color;
+		_mm_storeu_ps(&color.r, _mm_mul_ps(c, _mm_set1_ps(1 / 255.0f)));
+		return color;
+	}
+
+	// 32-bit multiplication of 4 lanes, SSE2 has only the 64-bit results of even lanes
+	static inline __m128i mullo_epi32(__m128i a, __m128i b)
+	{
+		__m128i even = _mm_mul_epu32(a, b);
+		__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+		return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+	}
+
+	static inline __m128i floor_epi32(__m128 f)
+	{
+		__m128i i = _mm_cvttps_epi32(f);
+		// truncation rounds negative values up, subtract 1 from them
+		return _mm_add_epi32(i, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(i), f)));
+	}
+
+	// x part of swizzle_index(): x1x0 at bit 0, x3x2 at bit 4, x5x4 at bit 8, and 64x64 block column at bit 12
+	static inline __m128i swizzle_x(__m128i x)
+	{
+		__m128i r = _mm_and_si128(x, _mm_set1_epi32(0x03));
+		r = _mm_or_si128(r, _mm_slli_epi32(_mm_and_si128(x, _mm_set1_epi32(0x0c)), 2));
+		r = _mm_or_si128(r, _mm_slli_epi32(_mm_and_si128(x, _mm_set1_epi32(0x30)), 4));
+		return _mm_or_si128(r, _mm_slli_epi32(_mm_srli_epi32(x, 6), 12));
+	}
+
+	// y part of swizzle_index(), "block_row" is the number of 64x64 blocks in a row
+	static inline __m128i swizzle_y(__m128i y, __m128i block_row)
+	{
+		__m128i r = _mm_slli_epi32(_mm_and_si128(y, _mm_set1_epi32(0x03)), 2);
+		r = _mm_or_si128(r, _mm_slli_epi32(_mm_and_si128(y, _mm_set1_epi32(0x0c)), 4));
+		r = _mm_or_si128(r, _mm_slli_epi32(_mm_and_si128(y, _mm_set1_epi32(0x30)), 6));
+		return _mm_add_epi32(r, _mm_slli_epi32(mullo_epi32(_mm_srli_epi32(y, 6), block_row), 12));
+	}
+
+	static inline __m128i gather_texels(const uint32_t *texels, __m128i index)
+	{
+		alignas(16) int32_t i[4];
+		_mm_store_si128((__m128i*)i, index);
+		return _mm_setr_epi32(int(texels[i[0]]), int(texels[i[1]]), int(texels[i[2]]), int(texels[i[3]]));
+	}
+
+	static inline __m128 texel_channel(__m128i texels, int shift)
+	{
+		return _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(texels, shift), _mm_set1_epi32(0xFF)));
+	}
 
-		x0 %= img_w;
-		y0 %= img_h;
-		x1 = (x0 + 1) % img_w;
-		y1 = (y0 + 1) % img_h;
+	// filter 4 pixels in SoA: each lane is a pixel, and channels are filtered one by one
+	void bilinear_filter_quad(const SwizzledTexture &tex, const vec2f *uv, color4f *color)
+	{
+		__m128 u = _mm_mul_ps(_mm_setr_ps(uv[0].x, uv[1].x, uv[2].x, uv[3].x), _mm_set1_ps(float(tex.width)));
+		__m128 v = _mm_mul_ps(_mm_setr_ps(uv[0].y, uv[1].y, uv[2].y, uv[3].y), _mm_set1_ps(float(tex.height)));
+		__m128i x0 = floor_epi32(u), y0 = floor_epi32(v);
+		u = _mm_sub_ps(u, _mm_cvtepi32_ps(x0));
+		v = _mm_sub_ps(v, _mm_cvtepi32_ps(y0));
+		const __m128i one = _mm_set1_epi32(1);
+		__m128i x1 = _mm_add_epi32(x0, one), y1 = _mm_add_epi32(y0, one);
+		if (tex.is_pow2) {
+			__m128i mask_x = _mm_set1_epi32(tex.width - 1), mask_y = _mm_set1_epi32(tex.height - 1);
+			x0 = _mm_and_si128(x0, mask_x);
+			x1 = _mm_and_si128(x1, mask_x);
+			y0 = _mm_and_si128(y0, mask_y);
+			y1 = _mm_and_si128(y1, mask_y);
+		}
+		else {
+			alignas(16) int32_t x[8], y[8];
+			_mm_store_si128((__m128i*)x, x0);
+			_mm_store_si128((__m128i*)(x + 4), x1);
+			_mm_store_si128((__m128i*)y, y0);
+			_mm_store_si128((__m128i*)(y + 4), y1);
+			for (int i = 0; i < 8; ++i)
+				tex.wrap(x[i], y[i]);
+			x0 = _mm_load_si128((const __m128i*)x);
+			x1 = _mm_load_si128((const __m128i*)(x + 4));
+			y0 = _mm_load_si128((const __m128i*)y);
+			y1 = _mm_load_si128((const __m128i*)(y + 4));
+		}
+		__m128i block_row = _mm_set1_epi32(tex.pitch >> 6);
+		__m128i sx0 = swizzle_x(x0), sx1 = swizzle_x(x1);
+		__m128i sy0 = swizzle_y(y0, block_row), sy1 = swizzle_y(y1, block_row);
+		const uint32_t *texels = tex.texels();
+		__m128i t00 = gather_texels(texels, _mm_add_epi32(sx0, sy0));
+		__m128i t10 = gather_texels(texels, _mm_add_epi32(sx1, sy0));
+		__m128i t01 = gather_texels(texels, _mm_add_epi32(sx0, sy1));
+		__m128i t11 = gather_texels(texels, _mm_add_epi32(sx1, sy1));
 
-		color4f c1, c2, c3, c4;
-		c1 = image->get_color(x0, y0);
-		c2 = image->get_color(x1, y0);
-		c3 = image->get_color(x1, y1);
-		c4 = image->get_color(x0, y1);
+		const __m128 scale = _mm_set1_ps(1 / 255.0f);
+		__m128 channel[4];
+		for (int k = 0; k < 4; ++k)
+		{
+			__m128 c00 = texel_channel(t00, k * 8), c10 = texel_channel(t10, k * 8);
+			__m128 c01 = texel_channel(t01, k * 8), c11 = texel_channel(t11, k * 8);
+			__m128 top = _mm_add_ps(c00, _mm_mul_ps(_mm_sub_ps(c10, c00), u));
+			__m128 bottom = _mm_add_ps(c01, _mm_mul_ps(_mm_sub_ps(c11, c01), u));
+			channel[k] = _mm_mul_ps(_mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), v)), scale);
+		}
+		_MM_TRANSPOSE4_PS(channel[0], channel[1], channel[2], channel[3]);
+		for (int i = 0; i < 4; ++i)
+			_mm_storeu_ps(&color[i].r, channel[i]);
+	}
 
-		s = 1 - u;
-		t = 1 - v;
+	void CSampler::sample2d_quad(const vec2f *uv, color4f *color)
+	{
+		for (int i = 0; i < 4; ++i)
+			sample2d(uv[i], color[i]);
+	}
 
-		c1 *= s * t;
-		c2 *= u * t;
-		c3 *= u * v;
-		c4 *= s * v;
-		return color4f{ c1 + c2 + c3 + c4 };
+	void CSampler::sample2d_grad(const vec2f *uv, const vec2f &duvdx, const vec2f &duvdy, color4f *color)
+	{
+		sample2d_quad(uv, color);
 	}
 
 	CSpwSampler::CSpwSampler(const CImage *image)
-		: m_image(image)
 	{
+		m_texture.create(image);
 	}
 
 	CSpwSampler::~CSpwSampler()
@@ -50,33 +192,104 @@ namespace wyc
 
 	void CSpwSampler::sample2d(const vec2f & uv, color4f & color)
 	{
-		color = bilinear_filter(m_image, uv);
+		color = bilinear_filter(m_texture, uv);
 	}
 
 	void CSpwSampler::sample2d(const vec2f & uv, uint8_t level, color4f & color)
 	{
-		color = bilinear_filter(m_image, uv);
+		color = bilinear_filter(m_texture, uv);
 	}
 
-	CSpwMipmapSampler::CSpwMipmapSampler(const ImageVector & mipmap_images)
-		: m_images(mipmap_images)
+	void CSpwSampler::sample2d_quad(const vec2f * uv, color4f * color)
 	{
+		bilinear_filter_quad(m_texture, uv, color);
 	}
 
-	CSpwMipmapSampler::CSpwMipmapSampler(ImageVector && mipmap_images)
-		: m_images(mipmap_images)
+	CSpwMipmapSampler::CSpwMipmapSampler(const ImageVector & mipmap_images)
+		: m_levels(mipmap_images.size())
+		, m_max_anisotropy(1)
 	{
+		for (size_t i = 0; i < mipmap_images.size(); ++i)
+			m_levels[i].create(mipmap_images[i].get());
 	}
 
 	void CSpwMipmapSampler::sample2d(const vec2f & uv, color4f & color)
 	{
-		color = bilinear_filter(m_images[0].get(), uv);
+		color = bilinear_filter(m_levels[0], uv);
 	}
 
 	void CSpwMipmapSampler::sample2d(const vec2f & uv, uint8_t level, color4f & color)
 	{
-		level = std::min<uint8_t>(level, uint8_t(m_images.size()) - 1);
-		color = bilinear_filter(m_images[level].get(), uv);
+		level = std::min<uint8_t>(level, uint8_t(m_levels.size()) - 1);
+		color = bilinear_filter(m_levels[level], uv);
+	}
+
+	void CSpwMipmapSampler::sample2d_quad(const vec2f * uv, color4f * color)
+	{
+		bilinear_filter_quad(m_levels[0], uv, color);
+	}
+
+	void CSpwMipmapSampler::sample2d_grad(const vec2f * uv, const vec2f & duvdx, const vec2f & duvdy, color4f * color)
+	{
+		// pixel footprint in texels of level 0
+		const SwizzledTexture &base = m_levels[0];
+		vec2f dx(duvdx.x * base.width, duvdx.y * base.height);
+		vec2f dy(duvdy.x * base.width, duvdy.y * base.height);
+		float px = dx ^ dx, py = dy ^ dy;
+		float major = std::sqrt(std::max(px, py)), minor = std::sqrt(std::min(px, py));
+		unsigned probes = 1;
+		if (m_max_anisotropy > 1 && major > minor) {
+			float ratio = minor > 0 ? std::min(major / minor, float(m_max_anisotropy)) : float(m_max_anisotropy);
+			probes = unsigned(std::ceil(ratio));
+		}
+		// each probe covers 1/probes of the major axis, so the level is chosen by the shorter footprint
+		float footprint = major / probes;
+		float lod = footprint > 1 ? std::log2(footprint) : 0;
+		if (probes == 1) {
+			trilinear_filter_quad(uv, lod, color);
+			return;
+		}
+		// probes are spread along the major axis in uv space, and all pixels of the quad share their positions
+		const vec2f &axis = px > py ? duvdx : duvdy;
+		vec2f probe_uv[4];
+		color4f probe_color[4];
+		for (int i = 0; i < 4; ++i)
+			color[i] = color4f(0, 0, 0, 0);
+		for (unsigned k = 0; k < probes; ++k)
+		{
+			float t = (k + 0.5f) / probes - 0.5f;
+			for (int i = 0; i < 4; ++i)
+				probe_uv[i] = uv[i] + axis * t;
+			trilinear_filter_quad(probe_uv, lod, probe_color);
+			for (int i = 0; i < 4; ++i)
+				color[i] += probe_color[i];
+		}
+		float weight = 1.0f / probes;
+		for (int i = 0; i < 4; ++i)
+			color[i] *= weight;
+	}
+
+	void CSpwMipmapSampler::set_max_anisotropy(unsigned count)
+	{
+		m_max_anisotropy = std::max(1u, std::min<unsigned>(count, SPW_MAX_ANISOTROPY));
+	}
+
+	void CSpwMipmapSampler::trilinear_filter_quad(const vec2f * uv, float lod, color4f * color) const
+	{
+		unsigned last = unsigned(m_levels.size()) - 1;
+		unsigned level = unsigned(lod);
+		if (level >= last) {
+			bilinear_filter_quad(m_levels[last], uv, color);
+			return;
+		}
+		bilinear_filter_quad(m_levels[level], uv, color);
+		float f = lod - level;
+		if (f <= 0)
+			return;
+		color4f next[4];
+		bilinear_filter_quad(m_levels[level + 1], uv, next);
+		for (int i = 0; i < 4; ++i)
+			color[i] += (next[i] - color[i]) * f;
 	}
 
-} // namespace wyc
+} // namespace wyc
\ No newline at end of file
@@ -1,29 +1,75 @@
 #pragma once
+#include <vector>
 #include <ImathVec.h>
 #include <ImathColor.h>
 #include "vecmath.h"
 #include "image.h"
+#include "spw_config.h"
 
 namespace wyc
 {
+	// 32bpp texture stored in swizzled layout: 4x4 tiles in 16x16 tiles in 64x64 blocks
+	// texel (x, y) is at swizzle_index(x, y, pitch), "pitch" is the width padded to 64
+	// power of 2 sizes wrap by masking, others by modulo
+	struct SwizzledTexture
+	{
+		// a row of 4x4 tile, 16 bytes aligned for SIMD swizzling
+		struct alignas(16) TexelRow
+		{
+			uint32_t texels[4];
+		};
+		std::vector<TexelRow> storage;
+		unsigned width;
+		unsigned height;
+		unsigned pitch;
+		bool is_pow2;
+
+		bool create(const CImage *image);
+		inline const uint32_t* texels() const
+		{
+			return (const uint32_t*)storage.data();
+		}
+		inline void wrap(int &x, int &y) const
+		{
+			if (is_pow2) {
+				x &= width - 1;
+				y &= height - 1;
+			}
+			else {
+				x %= int(width);
+				y %= int(height);
+				if (x < 0) x += width;
+				if (y < 0) y += height;
+			}
+		}
+	};
+
 	class CSampler
 	{
 	public:
 		virtual ~CSampler() {}
 		virtual void sample2d(const vec2f &uv, color4f &color) = 0;
 		virtual void sample2d(const vec2f &uv, uint8_t level, color4f &color) = 0;
+		// sample the 4 pixels of a 2x2 quad at once
+		// the default implementation calls sample2d() one by one
+		virtual void sample2d_quad(const vec2f *uv, color4f *color);
+		// sample a 2x2 quad with uv derivatives of the quad, the level of detail is selected once for all pixels
+		// the default implementation ignores derivatives and calls sample2d_quad()
+		virtual void sample2d_grad(const vec2f *uv, const vec2f &duvdx, const vec2f &duvdy, color4f *color);
 	};
 
 	class CSpwSampler : public CSampler
 	{
 	public:
+		// texels are copied to swizzled storage, image can be released after
 		CSpwSampler(const CImage *image);
 		virtual ~CSpwSampler();
 		virtual void sample2d(const vec2f &uv, color4f &color) override;
 		virtual void sample2d(const vec2f &uv, uint8_t level, color4f &color) override;
+		virtual void sample2d_quad(const vec2f *uv, color4f *color) override;
 
 	protected:
-		const CImage *m_image;
+		SwizzledTexture m_texture;
 	};
 
 	class CSpwMipmapSampler : public CSampler
@@ -31,12 +77,20 @@ namespace wyc
 	public:
 		typedef std::vector<std::shared_ptr<CImage>> ImageVector;
 		CSpwMipmapSampler(const ImageVector &mipmap_images);
-		CSpwMipmapSampler(ImageVector &&mipmap_images);
 		virtual void sample2d(const vec2f &uv, color4f &color) override;
 		virtual void sample2d(const vec2f &uv, uint8_t level, color4f &color) override;
+		virtual void sample2d_quad(const vec2f *uv, color4f *color) override;
+		// adjacent levels are blended by trilinear filtering
+		// if max anisotropy > 1, up to that many probes are taken along the major axis of the pixel footprint
+		virtual void sample2d_grad(const vec2f *uv, const vec2f &duvdx, const vec2f &duvdy, color4f *color) override;
+		// probe count is clamped to [1, SPW_MAX_ANISOTROPY], 1 disables anisotropic filtering
+		void set_max_anisotropy(unsigned count);
 
 	protected:
-		ImageVector m_images;
+		std::vector<SwizzledTexture> m_levels;
+		unsigned m_max_anisotropy;
+
+		void trilinear_filter_quad(const vec2f *uv, float lod, color4f *color) const;
 	};
 
 } // namespace wyc
\ No newline at end of file
@@ -0,0 +1,40 @@
+#include "spw_bin.h"
+#include <cassert>
+
+namespace wyc
+{
+	CSpwBinPool::CSpwBinPool(size_t page_size)
+		: m_page_size(page_size)
+		, m_page_index(0)
+		, m_offset(0)
+		, m_used(0)
+	{
+	}
+
+	void* CSpwBinPool::alloc(size_t size)
+	{
+		// keep allocations 16 bytes aligned for SIMD load
+		size = (size + 15) & ~size_t(15);
+		assert(size <= m_page_size);
+		if (m_page_index >= m_pages.size() || m_offset + size > m_page_size)
+		{
+			if (m_page_index < m_pages.size())
+				m_page_index += 1;
+			if (m_page_index >= m_pages.size())
+				m_pages.emplace_back(new char[m_page_size]);
+			m_offset = 0;
+		}
+		char *ptr = m_pages[m_page_index].get() + m_offset;
+		m_offset += size;
+		m_used += size;
+		return ptr;
+	}
+
+	void CSpwBinPool::reset()
+	{
+		m_page_index = 0;
+		m_offset = 0;
+		m_used = 0;
+	}
+
+} // namespace wyc
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "spw_config.h"
+
+namespace wyc
+{
+	class CMaterial;
+
+	// primitive appended to a tile bin
+	struct BinEntry
+	{
+		// sequence number in primitive queue, used to restore submission order
+		int64_t seq;
+		// polygon vertices (in viewport space), allocated from bin pool
+		const float *vertices;
+		unsigned count;
+		unsigned stride;
+		const CMaterial *material;
+	};
+
+	typedef std::vector<BinEntry> TileBin;
+
+	// linear allocator for binned primitives
+	// memory pages are kept after reset, so they are allocated only in the first few frames
+	class CSpwBinPool
+	{
+	public:
+		CSpwBinPool(size_t page_size = 1 << 20);
+		void* alloc(size_t size);
+		// release all allocations of the frame
+		void reset();
+		// bytes allocated since last reset
+		size_t used() const {
+			return m_used;
+		}
+		// bytes reserved by pool
+		size_t capacity() const {
+			return m_pages.size() * m_page_size;
+		}
+
+	private:
+		std::vector<std::unique_ptr<char[]>> m_pages;
+		size_t m_page_size;
+		size_t m_page_index;
+		size_t m_offset;
+		size_t m_used;
+	};
+
+} // namespace wyc
@@ -22,6 +22,9 @@ namespace wyc
 
 	SPW_CMD_HANDLER(cmd_present)
 	{
+		// rasterize deferred draws
+		renderer->get_pipeline()->flush();
+		renderer->get_pipeline()->resolve();
 		renderer->spw_present();
 		auto *cmd = get_cmd(cmd_present);
 		cmd->is_done.set_value();
@@ -36,12 +39,8 @@ namespace wyc
 		{
 			return;
 		}
-		CSurface& surf = renderer->m_rt->get_color_buffer();
-		surf.clear(cmd->color);
-		if (renderer->m_rt->has_depth()) {
-			CSurface &depth = renderer->m_rt->get_depth_buffer();
-			depth.clear<float>(cmd->clear_z);
-		}
+		// tiles are cleared when they are drawn or presented
+		renderer->get_pipeline()->clear(cmd->color, cmd->clear_z);
 	}
 
 	SPW_CMD_HANDLER(cmd_draw_mesh)
@@ -2,12 +2,12 @@
 #include <cassert>
 #include <functional>
 #include <future>
+#include <chrono>
 #include "disruptor.h"
 #include "ImathBoxAlgo.h"
 #include "vecmath.h"
 #include "spw_rasterizer.h"
 #include "platform_info.h"
-#include "clipping.h"
 #include "metric.h"
 
 namespace wyc
@@ -15,8 +15,16 @@ namespace wyc
 	CSpwPipeline::CSpwPipeline()
 		: m_clock_wise(COUNTER_CLOCK_WISE)
 		, m_is_setup(false)
+		, m_is_deferred(false)
+		, m_vertex_cache_size(0)
 		, m_num_vertex_unit(1)
 		, m_num_fragment_unit(1)
+		, m_tile_col(0)
+		, m_tile_row(0)
+		, m_tile_w(SPW_TILE_W)
+		, m_tile_h(SPW_TILE_H)
+		, m_clear_color(0, 0, 0, 1)
+		, m_clear_depth(1)
 	{
 	}
 
@@ -41,6 +49,7 @@ namespace wyc
 			m_num_vertex_unit = 1;
 			m_num_fragment_unit = 1;
 		}
+		m_thread_pool = std::make_shared<CThreadPool>(m_num_vertex_unit + m_num_fragment_unit);
 		m_prim_writer = std::make_shared<disruptor::shared_write_cursor>(PRIMITIVE_QUEUE_SIZE);
 		for (int i = 0; i < m_num_fragment_unit; ++i) {
 			auto ptr = std::make_shared<disruptor::read_cursor>();
@@ -52,37 +61,56 @@ namespace wyc
 
 	void CSpwPipeline::set_render_target(std::shared_ptr<CSpwRenderTarget> rt)
 	{
+		// pending bins and clears belong to the old tiles
+		flush();
+		clear_pending_tiles();
+		m_bins.clear();
 		m_rt = rt;
 		unsigned surfw, surfh;
 		rt->get_size(surfw, surfh);
 		set_viewport({ { 0, 0 },{ int(surfw), int(surfh) } });
 
 		// split frame buffer into tiles
-		static_assert(SPW_TILE_W >= 2 && SPW_TILE_H >= 2, "tile size must be at least 2x2");
+		static_assert(SPW_TILE_W >= 2 && SPW_TILE_H >= 2 && SPW_TILE_MIN >= 2, "tile size must be at least 2x2");
 		static_assert((SPW_TILE_W & (SPW_TILE_W - 1)) == 0, "tile width must be pow of 2");
 		static_assert((SPW_TILE_H & (SPW_TILE_H - 1)) == 0, "tile height must be pow of 2");
-		constexpr int HALF_TILE_W = SPW_TILE_W >> 1, HALF_TILE_H = SPW_TILE_H >> 1;
-		constexpr int MASK_TILW_W = SPW_TILE_W - 1, MASK_TILE_H = SPW_TILE_H - 1;
-		int tile_x = (surfw + MASK_TILW_W) / SPW_TILE_W, tile_y = (surfh + MASK_TILE_H) / SPW_TILE_H;
+		static_assert((SPW_TILE_MIN & (SPW_TILE_MIN - 1)) == 0 && (SPW_TILE_MAX & (SPW_TILE_MAX - 1)) == 0, "tile size must be pow of 2");
+		m_tile_w = SPW_TILE_W;
+		m_tile_h = SPW_TILE_H;
+		// tile-local color & depth take at most half of L2 cache, the other half is left to bins and textures
+		size_t l2_size = get_platform_info().cache_size[1] / 2;
+		constexpr size_t pixel_size = sizeof(color4f) + sizeof(float);
+		if (l2_size >= SPW_TILE_MIN * SPW_TILE_MIN * pixel_size) {
+			int size = SPW_TILE_MAX;
+			while (size > SPW_TILE_MIN && size * size * pixel_size > l2_size)
+				size >>= 1;
+			m_tile_w = m_tile_h = size;
+		}
+		const int HALF_TILE_W = m_tile_w >> 1, HALF_TILE_H = m_tile_h >> 1;
+		const int MASK_TILW_W = m_tile_w - 1, MASK_TILE_H = m_tile_h - 1;
+		int tile_x = (surfw + MASK_TILW_W) / m_tile_w, tile_y = (surfh + MASK_TILE_H) / m_tile_h;
 		int margin_x = surfw & MASK_TILW_W, margin_y = surfh & MASK_TILE_H;
+		m_tile_col = tile_x;
+		m_tile_row = tile_y;
+		m_tiles.clear();
 		box2i tile_bounding = { { -HALF_TILE_W, -HALF_TILE_H },{ HALF_TILE_W, HALF_TILE_H } };
 		for (auto i = 0; i < tile_y; ++i) {
 			for (auto j = 0; j < tile_x; ++j)
 			{
-				vec2i center = { HALF_TILE_W + j * SPW_TILE_W, HALF_TILE_H + i * SPW_TILE_H };
+				vec2i center = { HALF_TILE_W + j * m_tile_w, HALF_TILE_H + i * m_tile_h };
 				m_tiles.emplace_back(m_rt.get(), tile_bounding, center);
 			}
 			// adjust last column tiles' bounding
 			if (margin_x > 0)
 			{
-				m_tiles.back().bounding.max.x -= SPW_TILE_W - margin_x;
+				m_tiles.back().bounding.max.x -= m_tile_w - margin_x;
 			}
 		}
 		// adjust last row tiles' bounding
 		if (margin_y > 0) {
 			for (auto i = m_tiles.size() - tile_x, end = m_tiles.size(); i < end; ++i)
 			{
-				m_tiles[i].bounding.max.y -= SPW_TILE_H - margin_y;
+				m_tiles[i].bounding.max.y -= m_tile_h - margin_y;
 			}
 		}
 	}
@@ -103,174 +131,73 @@ namespace wyc
 		//process(mesh, material);
 	}
 
-	void CSpwPipeline::process_async(const CMesh * mesh, const CMaterial * material)
+	bool CSpwPipeline::bind_stream(const CMesh *mesh, const CMaterial *material, VertexStream &stream) const
 	{
-		assert(mesh && material);
 		const CVertexBuffer &vb = mesh->vertex_buffer();
-		const CIndexBuffer &ib = mesh->index_buffer();
-		// setup render target
-		unsigned surfw, surfh;
-		m_rt->get_size(surfw, surfh);
-
-		// bind stream
 		auto &attrib_def = material->get_attrib_define();
 		if (!check_material(attrib_def))
-			return;
-		std::vector<const float*> attribs(attrib_def.in_count, nullptr);
+			return false;
+		stream.attribs.assign(attrib_def.in_count, nullptr);
 		for (unsigned i = 0; i < attrib_def.in_count; ++i)
 		{
 			auto &slot = attrib_def.in_attribs[i];
 			if (!vb.has_attribute(slot.usage)
 				|| vb.attrib_component(slot.usage) < slot.component)
-				return;
-			attribs[i] = (const float*)vb.attrib_stream(slot.usage);
+				return false;
+			stream.attribs[i] = (const float*)vb.attrib_stream(slot.usage);
 		}
-		unsigned vertex_stride = vb.vertex_component();
-		unsigned output_stride = attrib_def.out_stride;
+		stream.indices = &mesh->index_buffer();
+		stream.material = material;
+		stream.vertex_stride = vb.vertex_component();
+		stream.output_stride = attrib_def.out_stride;
+		return true;
+	}
+
+	void CSpwPipeline::process_async(const CMesh * mesh, const CMaterial * material)
+	{
+		assert(mesh && material);
+		const CIndexBuffer &ib = mesh->index_buffer();
+
+		// bind stream
+		VertexStream stream;
+		if (!bind_stream(mesh, material, stream))
+			return;
+		unsigned output_stride = stream.output_stride;
+		if (!m_is_deferred || m_bins.empty())
+			reset_bins();
+
+		// previous primitives have been binned
+		if (m_payload_pools.size() != size_t(m_num_vertex_unit))
+			m_payload_pools.resize(m_num_vertex_unit);
+		for (auto &pool : m_payload_pools)
+			pool.reset();
 
 		// generate vertex processors
 		unsigned triangle_count = unsigned(ib.size() / 3);
 		unsigned index_per_core = (triangle_count / m_num_vertex_unit) * 3;
 		unsigned index_beg = 0, index_end = index_per_core + (triangle_count % m_num_vertex_unit) * 3;
 		std::vector<std::future<void>> producers;
-		while (index_end <= ib.size())
+		for (unsigned producer = 0; index_end <= ib.size() && producer < m_payload_pools.size(); ++producer)
 		{
-			producers.push_back(std::async(std::launch::async, [this, &attribs, &ib, index_beg, index_end, vertex_stride, material, output_stride] {
-				auto attrib_count = attribs.size();
-				const float **vertex_in = new float const*[attrib_count];
-				// use triangle as the basic primitive (3 vertex)
-				// clipping may produce 7 more vertex
-				// so the maximum vertex count is 10
-				constexpr int max_count = 10;
-				// cache for vertex attributes 
-				size_t cache_vert = output_stride * max_count;
-				std::vector<float> vertex_out;
-				vertex_out.reserve(cache_vert);
-				std::vector<unsigned> indices_in, indices_out;
-				indices_in.reserve(max_count);
-				indices_out.reserve(max_count);
-
-				for (auto i = index_beg; i < index_end; ++i)
-				{
-					auto offset = ib[i] * vertex_stride;
-					for (size_t j = 0; j < attrib_count; ++j)
-					{
-						vertex_in[j] = attribs[j] + offset;
-					}
-					auto cur_vert = (unsigned)vertex_out.size();
-					vertex_out.resize(cur_vert + output_stride);
-					// #1 vertex shader
-					material->vertex_shader(vertex_in, &vertex_out[cur_vert]);
-					indices_in.push_back(cur_vert);
-					if (indices_in.size() < 3)
-						continue;
-					if (!cull_backface(vertex_out, output_stride)) {
-						// #2 geometry shader
-						material->geometry_shader(&vertex_out[0]);
-						clip_polygon_stream(vertex_out, indices_in, indices_out, output_stride);
-						if (indices_out.size() >= 3)
-						{
-							viewport_transform(vertex_out, indices_out);
-							// publish primitive
-							if (!indices_out.empty()) {
-								auto pos = m_prim_writer->claim(1);
-								auto &prim = m_prim_queue.at(pos);
-								prim.vertices.clear();
-								for (auto j : indices_out)
-								{
-									auto beg = &vertex_out[j];
-									prim.vertices.insert(prim.vertices.end(), beg, beg + output_stride);
-								}
-								prim.stride = output_stride;
-								prim.material = material;
-								m_prim_writer->publish_after(pos, pos - 1);
-								indices_out.clear();
-							}
-						} // publish primitive
-					} // backface culling
-					indices_in.clear();
-					vertex_out.clear();
-				} // end of for-loop
-				delete[] vertex_in;
+			CSpwBinPool *pool = &m_payload_pools[producer];
+			producers.push_back(m_thread_pool->submit([this, &stream, index_beg, index_end, material, output_stride, pool] {
+				process_vertex(stream, index_beg, index_end, [this, material, output_stride, pool](const std::vector<float> &vertex_out, const std::vector<unsigned> &indices_out) {
+					publish_primitive(vertex_out, indices_out, output_stride, material, pool);
+				});
 			}));
 			index_beg = index_end;
 			index_end += index_per_core;
 		}
 
-		// generate fragement processors
-		int tile_per_core = int(m_tiles.size() / m_num_fragment_unit);
-		int tile_beg = 0, tile_end = tile_per_core + m_tiles.size() % m_num_fragment_unit;
-		for (auto &tile : m_tiles) {
-			tile.set_fragment(output_stride, material);
-		}
-		std::vector<std::future<void>> consumers;
-		for(auto &cursor: m_prim_readers) {
-			consumers.push_back(std::async(std::launch::async, [this, cursor, tile_beg, tile_end] {
-				box2i vertex_bounding;
-				auto beg = cursor->begin();
-				auto end = cursor->end();
-				while (1) {
-					if (beg == end)
-					{
-						if (end > 0)
-							cursor->publish(end - 1);
-						end = cursor->wait_for(end);
-					}
-					const auto &prim = m_prim_queue.at(beg);
-					const float* vec = prim.vertices.data();
-					if (std::isnan(vec[0])) {
-						// EOF
-						cursor->publish(beg);
-						break;
-					}
-					const float* end = vec + prim.vertices.size();
-					const vec4f *p0 = (const vec4f*)vec;
-					vec += prim.stride;
-					const vec4f *p1 = (const vec4f*)vec;
-					vec += prim.stride;
-					const vec4f *p2 = (const vec4f*)vec;
-					while (vec < end)
-					{
-						Imath::bounding(vertex_bounding, p0, p1, p2);
-						for (auto i = tile_beg; i < tile_end; ++i) {
-							auto &tile = m_tiles[i];
-							box2i local_bounding = vertex_bounding;
-							local_bounding.min -= tile.center;
-							local_bounding.max -= tile.center;
-							Imath::intersection(local_bounding, tile.bounding);
-							if (local_bounding.hasVolume()) {
-								// fill triangles
-								vec3f v0, v1, v2;
-								v0.x = p0->x - tile.center.x;
-								v0.y = p0->y - tile.center.y;
-								v0.z = p0->z;
-								v1.x = p1->x - tile.center.x;
-								v1.y = p1->y - tile.center.y;
-								v1.z = p1->z;
-								v2.x = p2->x - tile.center.x;
-								v2.y = p2->y - tile.center.y;
-								// make sure bounding area fit in 2x2 block
-								v2.z = p2->z;
-								auto &low = local_bounding.min;
-								auto &upp = local_bounding.max;
-								low.x &= ~1;
-								low.y &= ~1;
-								upp.x = (upp.x + 1) & ~1;
-								upp.y = (upp.y + 1) & ~1;
-								// fill bounding area
-								tile.set_triangle((float*)p0, (float*)p1, (float*)p2);
-								fill_triangle_quad(local_bounding, v0, v1, v2, tile);
-							} // bounding not empty
-						} // tile loop
-						vec += prim.stride;
-						p1 = p2;
-						p2 = (const vec4f*)vec;
-					} // index loop
-					++beg;
-				}
+		// generate binners
+		unsigned binner_count = unsigned(m_prim_readers.size());
+		std::vector<std::future<void>> binners;
+		for (unsigned k = 0; k < binner_count; ++k) {
+			binners.push_back(m_thread_pool->submit([this, k] {
+				read_primitives(k, [this, k](const Primitive &prim, int64_t seq) {
+					bin_primitive(prim, seq, k);
+				});
 			}));
-			tile_beg = tile_end;
-			tile_end += tile_per_core;
 		}
 
 		// wait for producers
@@ -279,50 +206,361 @@ namespace wyc
 			h.get();
 		}
 
-		// use NAN to indicate EOF
+		publish_eof();
+
+		// wait for binners
+		for (auto &h : binners)
+		{
+			h.get();
+		}
+
+		if (!m_is_deferred)
+			draw_bins();
+	}
+
+	void CSpwPipeline::publish_primitive(const std::vector<float> &vertices, const std::vector<unsigned> &indices, unsigned stride, const CMaterial *material, CSpwBinPool *pool)
+	{
+		auto pos = m_prim_writer->claim(1);
+		auto &prim = m_prim_queue.at(pos);
+		unsigned count = unsigned(indices.size());
+		size_t size = count * stride;
+		float *dst = size <= PRIMITIVE_PAYLOAD_SIZE ? prim.payload : (float*)pool->alloc(size * sizeof(float));
+		prim.vertices = dst;
+		for (auto j : indices)
+		{
+			memcpy(dst, &vertices[j], stride * sizeof(float));
+			dst += stride;
+		}
+		prim.count = count;
+		prim.stride = stride;
+		prim.material = material;
+		m_prim_writer->publish_after(pos, pos - 1);
+	}
+
+	void CSpwPipeline::publish_eof()
+	{
+		// use empty primitive to indicate EOF
 		auto pos = m_prim_writer->claim(1);
-		m_prim_queue.at(pos).vertices.assign(1, NAN);
+		m_prim_queue.at(pos).vertices = nullptr;
 		m_prim_writer->publish_after(pos, pos - 1);
+	}
+
+	void CSpwPipeline::set_deferred(bool is_deferred)
+	{
+		if (m_is_deferred == is_deferred)
+			return;
+		flush();
+		m_is_deferred = is_deferred;
+	}
+
+	void CSpwPipeline::flush()
+	{
+		if (!m_is_deferred)
+			return;
+		draw_bins();
+		reset_bins();
+	}
+
+	void CSpwPipeline::resolve()
+	{
+		clear_pending_tiles();
+		if (m_rt && m_rt->is_swizzled())
+			m_rt->linearize();
+	}
+
+	void CSpwPipeline::present(uint32_t *dst, unsigned dpitch)
+	{
+		flush();
+		if (!m_rt)
+			return;
+		if (m_rt->is_swizzled())
+			// swizzled color is linearized by present_rect
+			clear_pending_tiles();
+		else
+			resolve();
+		unsigned w, h;
+		m_rt->get_size(w, h);
+		unsigned col = (w + 63) / 64, row = (h + 63) / 64;
+		m_thread_pool->parallel_for(col * row, [this, dst, dpitch, w, h, col](unsigned i) {
+			unsigned x = i % col * 64, y = i / col * 64;
+			m_rt->present_rect(dst, dpitch, x, y, std::min(64u, w - x), std::min(64u, h - y));
+		});
+	}
 
-		// wait for consumers
-		for (auto &h : consumers)
+	void CSpwPipeline::clear(const color4f &color, float depth)
+	{
+		// deferred draws should be rasterized before the buffers are cleared
+		flush();
+		m_clear_color = color;
+		m_clear_depth = depth;
+		m_clear_tiles.assign(m_tiles.size(), 1);
+	}
+
+	void CSpwPipeline::clear_pending_tiles()
+	{
+		if (m_clear_tiles.empty())
+			return;
+		dispatch_tiles([this](unsigned tile_index, unsigned) {
+			if (m_clear_tiles[tile_index])
+				m_tiles[tile_index].clear(m_clear_color, m_clear_depth);
+		});
+		m_clear_tiles.clear();
+	}
+
+	void CSpwPipeline::draw_bins()
+	{
+		if (m_bins.empty())
+			return;
+		// generate fragement processors
+		dispatch_tiles([this](unsigned tile_index, unsigned unit) {
+			draw_tile_bins(tile_index, &m_tile_buffers[unit]);
+		});
+
+		// bin occupancy
+		size_t occupied = 0;
+		size_t binner_count = m_bin_pools.size();
+		for (size_t i = 0, tile_count = m_tiles.size(); i < tile_count; ++i)
 		{
-			h.get();
+			size_t entry_count = 0;
+			for (size_t k = 0; k < binner_count; ++k)
+				entry_count += m_bins[k * tile_count + i].size();
+			if (entry_count) {
+				occupied += 1;
+				BIN_ENTRY(entry_count)
+				BIN_MAX_OCCUPANCY(entry_count)
+			}
+		}
+		BIN_OCCUPIED(occupied)
+		for (auto &pool : m_bin_pools)
+		{
+			BIN_POOL_SIZE(pool.used())
+		}
+	}
+
+	void CSpwPipeline::reset_bins()
+	{
+		size_t bin_count = m_prim_readers.size() * m_tiles.size();
+		if (m_bins.size() != bin_count)
+			m_bins.resize(bin_count);
+		for (auto &bin : m_bins)
+			bin.clear();
+		if (m_bin_pools.size() != m_prim_readers.size())
+			m_bin_pools.resize(m_prim_readers.size());
+		for (auto &pool : m_bin_pools)
+			pool.reset();
+	}
+
+	void CSpwPipeline::bin_primitive(const Primitive &prim, int64_t seq, unsigned binner)
+	{
+		unsigned stride = prim.stride;
+		unsigned count = prim.count;
+		// polygon bounding in tiles
+		const float *vec = prim.vertices;
+		float minx = vec[0], maxx = vec[0], miny = vec[1], maxy = vec[1];
+		for (unsigned i = 1; i < count; ++i)
+		{
+			vec += stride;
+			minx = std::min(minx, vec[0]);
+			maxx = std::max(maxx, vec[0]);
+			miny = std::min(miny, vec[1]);
+			maxy = std::max(maxy, vec[1]);
 		}
+		// division truncates toward 0, so polygons left of or above render target are rejected before it
+		if (maxx < 0 || maxy < 0)
+			return;
+		int x0 = std::max(fast_floor(minx), 0) / m_tile_w;
+		int y0 = std::max(fast_floor(miny), 0) / m_tile_h;
+		int x1 = std::min(fast_floor(maxx) / m_tile_w, m_tile_col - 1);
+		int y1 = std::min(fast_floor(maxy) / m_tile_h, m_tile_row - 1);
+		// polygons right of or below render target have x0 > x1 or y0 > y1
+		if (x0 > x1 || y0 > y1)
+			return;
+		// copy vertices to pool, the queue slot will be reused
+		size_t size = count * stride * sizeof(float);
+		float *vertices = (float*)m_bin_pools[binner].alloc(size);
+		memcpy(vertices, prim.vertices, size);
+		TileBin *bins = &m_bins[binner * m_tiles.size()];
+		for (int y = y0; y <= y1; ++y)
+		{
+			for (int x = x0; x <= x1; ++x)
+			{
+				bins[y * m_tile_col + x].push_back({ seq, vertices, count, stride, prim.material });
+			}
+		}
+	}
+
+	void CSpwPipeline::draw_tile_bins(size_t tile_index, TileBuffer *buffer)
+	{
+		constexpr unsigned MAX_BINNER = 64;
+		unsigned binner_count = unsigned(m_prim_readers.size());
+		assert(binner_count <= MAX_BINNER);
+		size_t tile_count = m_tiles.size();
+		const BinEntry *cur[MAX_BINNER], *end[MAX_BINNER];
+		size_t entry_count = 0;
+		for (unsigned k = 0; k < binner_count; ++k)
+		{
+			auto &bin = m_bins[k * tile_count + tile_index];
+			cur[k] = bin.data();
+			end[k] = bin.data() + bin.size();
+			entry_count += bin.size();
+		}
+		// tiles without primitives are not loaded
+		if (!entry_count)
+			return;
+		auto &tile = m_tiles[tile_index];
+		if (!m_clear_tiles.empty() && m_clear_tiles[tile_index]) {
+			// the first draw since clear() fills the tile in cache
+			m_clear_tiles[tile_index] = 0;
+			tile.load(buffer, m_clear_color, m_clear_depth);
+		}
+		else {
+			tile.load(buffer);
+		}
+		const CMaterial *material = nullptr;
+		box2i vertex_bounding;
+		while (1) {
+			// merge bins by sequence number to keep submission order
+			const BinEntry *entry = nullptr;
+			unsigned pick = 0;
+			for (unsigned k = 0; k < binner_count; ++k)
+			{
+				if (cur[k] < end[k] && (!entry || cur[k]->seq < entry->seq))
+				{
+					entry = cur[k];
+					pick = k;
+				}
+			}
+			if (!entry)
+				break;
+			cur[pick] += 1;
+			if (entry->material != material) {
+				// bins may contain primitives of different draws
+				material = entry->material;
+				tile.set_fragment(entry->stride, material);
+			}
+			const float* vec = entry->vertices;
+			const float* vec_end = vec + entry->count * entry->stride;
+			const vec4f *p0 = (const vec4f*)vec;
+			vec += entry->stride;
+			const vec4f *p1 = (const vec4f*)vec;
+			vec += entry->stride;
+			const vec4f *p2 = (const vec4f*)vec;
+			while (vec < vec_end)
+			{
+				Imath::bounding(vertex_bounding, p0, p1, p2);
+				box2i local_bounding = vertex_bounding;
+				local_bounding.min -= tile.center;
+				local_bounding.max -= tile.center;
+				Imath::intersection(local_bounding, tile.bounding);
+				if (local_bounding.hasVolume()) {
+					// fill triangles
+					vec3f v0, v1, v2;
+					v0.x = p0->x - tile.center.x;
+					v0.y = p0->y - tile.center.y;
+					v0.z = p0->z;
+					v1.x = p1->x - tile.center.x;
+					v1.y = p1->y - tile.center.y;
+					v1.z = p1->z;
+					v2.x = p2->x - tile.center.x;
+					v2.y = p2->y - tile.center.y;
+					v2.z = p2->z;
+					// make sure bounding area fit in 2x2 block
+					auto &low = local_bounding.min;
+					auto &upp = local_bounding.max;
+					low.x &= ~1;
+					low.y &= ~1;
+					upp.x = (upp.x + 1) & ~1;
+					upp.y = (upp.y + 1) & ~1;
+					// fill bounding area
+					tile.set_triangle((float*)p0, (float*)p1, (float*)p2);
+					fill_triangle_quad(local_bounding, v0, v1, v2, tile);
+				} // bounding not empty
+				vec += entry->stride;
+				p1 = p2;
+				p2 = (const vec4f*)vec;
+			} // index loop
+		} // bin loop
+		tile.store();
 	}
 
 	void CSpwPipeline::clear_async()
 	{
-		int tile_per_core = int(m_tiles.size() / m_num_fragment_unit);
-		int tile_beg = 0, tile_end = tile_per_core + m_tiles.size() % m_num_fragment_unit;
-		std::vector<std::future<void>> consumers;
 		constexpr int COLOR_COUNT = 6;
 		const color3f colors[COLOR_COUNT] = {
 			{ 1, 0, 0 },{ 0, 1, 0 },{ 0, 0, 1 },
 			{ 1, 1, 0 },{ 1, 0, 1 },{ 0, 1, 1 },
 		};
-		for (auto c = 0; c < m_num_fragment_unit; ++c) {
-			consumers.push_back(std::async(std::launch::async, [=, &colors] {
-				for (auto i = tile_beg; i < tile_end; ++i)
-				{
-					auto &tile = m_tiles[i];
-					tile.clear(colors[i % COLOR_COUNT]);
-				}
-			}));
+		dispatch_tiles([this, &colors](unsigned i, unsigned) {
+			m_tiles[i].clear(colors[i % COLOR_COUNT], 1.0f);
+		});
+		m_clear_tiles.clear();
+	}
+
+	void CSpwPipeline::dispatch_tiles(const std::function<void(unsigned, unsigned)> &task)
+	{
+		typedef std::chrono::steady_clock clock_t;
+		unsigned worker_count = unsigned(m_num_fragment_unit);
+		unsigned tile_count = unsigned(m_tiles.size());
+		while (m_tile_queues.size() < worker_count)
+			m_tile_queues.emplace_back(new CWorkStealingQueue<unsigned>);
+		if (m_tile_buffers.size() != worker_count)
+			m_tile_buffers.resize(worker_count);
+		// seed queues with contiguous tile ranges
+		// tiles are pushed in reverse order, so the owner pops them in order and thieves steal from the far end
+		unsigned tile_per_core = tile_count / worker_count;
+		unsigned tile_beg = 0, tile_end = tile_per_core + tile_count % worker_count;
+		for (unsigned w = 0; w < worker_count; ++w)
+		{
+			auto &queue = *m_tile_queues[w];
+			queue.reset(tile_end - tile_beg);
+			for (auto i = tile_end; i > tile_beg; --i)
+				queue.push(i - 1);
 			tile_beg = tile_end;
 			tile_end += tile_per_core;
 		}
-		// wait for consumers
-		for (auto &h : consumers)
+		std::vector<float> busy_time(worker_count, 0);
+		std::vector<std::future<void>> workers;
+		auto start = clock_t::now();
+		for (unsigned w = 0; w < worker_count; ++w)
+		{
+			workers.push_back(m_thread_pool->submit([this, w, worker_count, &task, &busy_time] {
+				auto &queue = *m_tile_queues[w];
+				float busy = 0;
+				unsigned tile_index;
+				while (1) {
+					if (!queue.pop(tile_index))
+					{
+						// steal from the other units
+						bool found = false;
+						for (unsigned i = 1; i < worker_count && !found; ++i)
+							found = m_tile_queues[(w + i) % worker_count]->steal(tile_index);
+						if (!found)
+							break;
+					}
+					auto t0 = clock_t::now();
+					task(tile_index, w);
+					busy += std::chrono::duration<float, std::milli>(clock_t::now() - t0).count();
+				}
+				busy_time[w] = busy;
+			}));
+		}
+		for (auto &h : workers)
 		{
 			h.get();
 		}
+		// idle time includes stealing and waiting for the slowest unit
+		float total = std::chrono::duration<float, std::milli>(clock_t::now() - start).count();
+		for (unsigned w = 0; w < worker_count; ++w)
+		{
+			WORKER_TIME(w, busy_time[w], total - busy_time[w])
+		}
 	}
 
-	void CSpwPipeline::process(const CMesh *mesh, const CMaterial *material) const
+	void CSpwPipeline::process(const CMesh *mesh, const CMaterial *material)
 	{
 		assert(mesh && material);
-		const CVertexBuffer &vb = mesh->vertex_buffer();
+		// the full frame tile doesn't know pending clears of the tiles
+		clear_pending_tiles();
 		const CIndexBuffer &ib = mesh->index_buffer();
 		// setup render target
 		unsigned surfw, surfh;
@@ -330,63 +568,18 @@ namespace wyc
 		int halfw = surfw >> 1, halfh = surfh >> 1;
 
 		// bind stream
-		auto &attrib_def = material->get_attrib_define();
-		if (!check_material(attrib_def))
+		VertexStream stream;
+		if (!bind_stream(mesh, material, stream))
 			return;
-		std::vector<const float*> attribs;
-		attribs.resize(attrib_def.in_count);
-		for (unsigned i = 0; i < attrib_def.in_count; ++i)
-		{
-			auto &slot = attrib_def.in_attribs[i];
-			if (!vb.has_attribute(slot.usage)
-				|| vb.attrib_component(slot.usage) < slot.component)
-				return;
-			attribs[i] = (const float*)vb.attrib_stream(slot.usage);
-		}
-
-		unsigned vertex_stride = vb.vertex_component();
-		unsigned output_stride = attrib_def.out_stride;
-		auto attrib_count = attribs.size();
-		const float **vertex_in = new float const*[attrib_count];
-		// use triangle as the basic primitive (3 vertex)
-		// clipping may produce 7 more vertex
-		// so the maximum vertex count is 10
-		constexpr int max_count = 10;
-		// cache for vertex attributes 
-		size_t cache_vert = output_stride * max_count;
-		std::vector<float> vertex_out;
-		vertex_out.reserve(cache_vert);
-		std::vector<unsigned> indices_in, indices_out;
-		indices_in.reserve(max_count);
-		indices_out.reserve(max_count);
+		unsigned output_stride = stream.output_stride;
 		CTile tile(m_rt.get(), box2i{ { -halfw, -halfh },{ halfw, halfh } }, vec2i{ halfw, halfh });
 		tile.set_fragment(output_stride, material);
-		for (size_t i = 0; i < ib.size(); ++i)
-		{
-			auto offset = ib[i] * vertex_stride;
-			for (size_t j = 0; j < attrib_count; ++j)
-			{
-				vertex_in[j] = attribs[j] + offset;
-			}
-			auto cur_vert = (unsigned)vertex_out.size();
-			vertex_out.resize(cur_vert + output_stride);
-			material->vertex_shader(vertex_in, &vertex_out[cur_vert]);
-			indices_in.push_back(cur_vert);
-			if (indices_in.size() < 3)
-				continue;
-			if (!cull_backface(vertex_out, output_stride)) {
-				clip_polygon_stream(vertex_out, indices_in, indices_out, output_stride);
-				if (indices_out.size() >= 3)
-				{
-					viewport_transform(vertex_out, indices_out);
-					draw_triangles(vertex_out, indices_out, output_stride, tile);
-				}
-			}
-			indices_in.clear();
-			vertex_out.clear();
-		} // index buffer loop
-
-		delete[] vertex_in;
+		TileBuffer buffer;
+		tile.load(&buffer);
+		process_vertex(stream, 0, ib.size(), [this, &tile, output_stride](const std::vector<float> &vertex_out, const std::vector<unsigned> &indices_out) {
+			draw_triangles(vertex_out, indices_out, output_stride, tile);
+		});
+		tile.store();
 	}
 
 	bool CSpwPipeline::cull_backface(const std::vector<float> &vertices, unsigned stride) const
@@ -407,6 +600,14 @@ namespace wyc
 		m_vp_translate = { _tmp.x * 0.5f, _tmp.y * 0.5f };
 		_tmp = view.max - view.min;
 		m_vp_scale = { _tmp.x * 0.5f, _tmp.y * 0.5f };
+		// tiles rasterize coordinates relative to their centers, which should be inside [-SPW_MAX_TARGET_SIZE, SPW_MAX_TARGET_SIZE)
+		// so the margin beyond each side of viewport is limited to (SPW_MAX_TARGET_SIZE - viewport size)
+		// guard band is a scale of viewport in NDC, 1 is the viewport itself
+		float margin_x = std::max(std::min(float(SPW_GUARD_BAND_SIZE), float(SPW_MAX_TARGET_SIZE - _tmp.x)), 0.0f);
+		float margin_y = std::max(std::min(float(SPW_GUARD_BAND_SIZE), float(SPW_MAX_TARGET_SIZE - _tmp.y)), 0.0f);
+		m_guard_band.x = 1 + 2 * margin_x / _tmp.x;
+		m_guard_band.y = 1 + 2 * margin_y / _tmp.y;
+		assert(m_guard_band.x >= 1 && m_guard_band.y >= 1);
 	}
 
 	void CSpwPipeline::viewport_transform(std::vector<float>& vertices, const std::vector<unsigned>& indices) const
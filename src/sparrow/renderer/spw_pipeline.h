@@ -1,4 +1,6 @@
 #pragma once
+#include <algorithm>
+#include <functional>
 #include <ImathMatrix.h>
 #include <ImathBox.h>
 #include <ImathColorAlgo.h>
@@ -10,6 +12,11 @@
 #include "material.h"
 #include "disruptor.h"
 #include "tile.h"
+#include "clipping.h"
+#include "spw_bin.h"
+#include "work_stealing_queue.h"
+#include "thread_pool.h"
+#include "metric.h"
 
 namespace wyc
 {
@@ -27,37 +34,272 @@ namespace wyc
 		CSpwPipeline(const CSpwPipeline &other) = delete;
 		CSpwPipeline& operator = (const CSpwPipeline &other) = delete;
 		void setup(unsigned max_core=MAX_CORE_NUM);
-		void set_render_target(std::shared_ptr<CSpwRenderTarget> rt);
+		virtual void set_render_target(std::shared_ptr<CSpwRenderTarget> rt);
 		virtual void feed(const CMesh *mesh, const CMaterial *material);
 		void set_viewport(const box2i &view);
+		// in deferred mode, draws are vertex processed and binned when they are fed,
+		// and all of them are rasterized together by flush()
+		// meshes and materials should be kept alive until flush()
+		void set_deferred(bool is_deferred);
+		bool is_deferred() const {
+			return m_is_deferred;
+		}
+		// rasterize pending draws
+		virtual void flush();
+		// resolve the rendered samples of a multi-sampled render target, after flush()
+		// this pipeline always renders to pixels, so it only clears the pending tiles and linearizes swizzled render target
+		virtual void resolve();
+		// clear render target after pending draws are rasterized
+		// the clear is deferred: a tile is filled with clear values when it's loaded for drawing, or by resolve() if it's not drawn
+		virtual void clear(const color4f &color, float depth);
+		// rasterize pending draws, resolve render target and convert it to 8-bit sRGB image "dst"
+		// "dpitch" is the distance between rows in pixels, image should be as large as render target
+		// 64x64 tiles are converted in parallel on pipeline workers
+		void present(uint32_t *dst, unsigned dpitch);
+		// by default, vertex stage shades each unique vertex of its index range once
+		// if size > 0, vertices are streamed through a FIFO cache of "size" transformed vertices instead,
+		// which needs less memory for large ranges but may shade a vertex more than once
+		void set_vertex_cache(unsigned size) {
+			m_vertex_cache_size = size;
+		}
+		// worker threads of the pipeline, which can be shared by other subsystems
+		std::shared_ptr<CThreadPool> get_thread_pool() const {
+			return m_thread_pool;
+		}
 
 	protected:
 		typedef std::pair<const char*, size_t> AttribStream;
+		// vertex input bound to a material
+		struct VertexStream {
+			std::vector<const float*> attribs;
+			const CIndexBuffer *indices;
+			const CMaterial *material;
+			unsigned vertex_stride;
+			unsigned output_stride;
+		};
 		POLYGON_WINDING m_clock_wise;
 		std::shared_ptr<CSpwRenderTarget> m_rt;
 		vec2f m_vp_translate;
 		vec2f m_vp_scale;
+		// guard band extent relative to the viewport
+		vec2f m_guard_band;
 		// async render
 		bool m_is_setup;
+		bool m_is_deferred;
+		unsigned m_vertex_cache_size;
 		int m_num_vertex_unit;
 		int m_num_fragment_unit;
+		// one worker for each vertex and fragment unit, since producers and binners run at the same time
+		std::shared_ptr<CThreadPool> m_thread_pool;
+		// publishing a primitive never allocates: vertices are copied to the inline payload,
+		// or to the payload pool of the producer if they don't fit
 		struct CACHE_LINE_ALIGN Primitive {
-			std::vector<float> vertices;
+			float payload[PRIMITIVE_PAYLOAD_SIZE];
+			// polygon vertices, nullptr indicates EOF
+			const float *vertices;
+			unsigned count;
 			unsigned stride;
 			const CMaterial *material;
 		};
 		disruptor::ring_buffer<Primitive, PRIMITIVE_QUEUE_SIZE> m_prim_queue;
 		disruptor::shared_write_cursor_ptr m_prim_writer;
 		std::vector<disruptor::read_cursor_ptr> m_prim_readers;
+		// one pool for each vertex unit, reset at the beginning of each draw
+		std::vector<CSpwBinPool> m_payload_pools;
 		std::vector<CTile> m_tiles;
+		int m_tile_col;
+		int m_tile_row;
+		// tile size in pixels, chosen by L2 cache size
+		int m_tile_w;
+		int m_tile_h;
+		// tile-local buffer of each fragment unit
+		std::vector<TileBuffer> m_tile_buffers;
+		// deferred clear values, and the tiles (or blocks) waiting for them
+		color4f m_clear_color;
+		float m_clear_depth;
+		std::vector<uint8_t> m_clear_tiles;
+		// sort-middle binning
+		// each binner owns a pool and a bin for every tile: m_bins[binner * tile_count + tile]
+		std::vector<CSpwBinPool> m_bin_pools;
+		std::vector<TileBin> m_bins;
+		// tile queue of each fragment unit
+		std::vector<std::unique_ptr<CWorkStealingQueue<unsigned>>> m_tile_queues;
 
 		bool check_material(const AttribDefine &attrib_def) const;
-		virtual void process(const CMesh *mesh, const CMaterial *material) const;
+		bool bind_stream(const CMesh *mesh, const CMaterial *material, VertexStream &stream) const;
+		// vertex stage: shade, cull and clip triangles in index range [index_beg, index_end)
+		// each visible polygon is passed to handler(vertices, indices) in viewport space
+		template<class PolygonHandler>
+		void process_vertex(const VertexStream &stream, size_t index_beg, size_t index_end, PolygonHandler &&handler) const;
+		virtual void process(const CMesh *mesh, const CMaterial *material);
 		virtual void process_async(const CMesh *mesh, const CMaterial *material);
 		void clear_async();
+		// publish polygon "indices" of "vertices" to the primitive queue, called by vertex units
+		// vertices which don't fit the inline payload are allocated from "pool"
+		void publish_primitive(const std::vector<float> &vertices, const std::vector<unsigned> &indices, unsigned stride, const CMaterial *material, CSpwBinPool *pool);
+		// tell binners that all primitives of the draw are published
+		void publish_eof();
+		// take primitives from the queue until EOF, called by binners
+		// binner k takes primitives whose sequence % binner_count == k, and passes them to handler(prim, seq)
+		template<class PrimitiveHandler>
+		void read_primitives(unsigned binner, PrimitiveHandler &&handler);
+		// append primitive to bins of the tiles it overlaps
+		void bin_primitive(const Primitive &prim, int64_t seq, unsigned binner);
+		// draw primitives in tile bins to the tile-local buffer, in submission order
+		void draw_tile_bins(size_t tile_index, TileBuffer *buffer);
+		void reset_bins();
+		// write clear values to the tiles which are not drawn since clear()
+		virtual void clear_pending_tiles();
+		// rasterize all bins and report bin occupancy
+		void draw_bins();
+		// run task(tile_index, unit_index) for all tiles on fragment units
+		// each unit starts with a contiguous range of tiles and steals from others when it runs out of work
+		void dispatch_tiles(const std::function<void(unsigned, unsigned)> &task);
 		void viewport_transform(std::vector<float> &vertices, const std::vector<unsigned> &indices) const;
 		bool cull_backface(const std::vector<float> &vertices, unsigned stride) const;
 		virtual void draw_triangles(const std::vector<float> &vertices, const std::vector<unsigned> &indices, unsigned stride, CTile &tile) const;
 	};
 
+	template<class PolygonHandler>
+	void CSpwPipeline::process_vertex(const VertexStream &stream, size_t index_beg, size_t index_end, PolygonHandler &&handler) const
+	{
+		const CIndexBuffer &ib = *stream.indices;
+		const CMaterial *material = stream.material;
+		auto attrib_count = stream.attribs.size();
+		unsigned vertex_stride = stream.vertex_stride;
+		unsigned output_stride = stream.output_stride;
+		// use triangle as the basic primitive (3 vertex)
+		// clipping may produce 7 more vertex
+		// so the maximum vertex count is 10
+		constexpr int max_count = 10;
+		// cache for vertex attributes 
+		size_t cache_vert = output_stride * max_count;
+		std::vector<float> vertex_out;
+		vertex_out.reserve(cache_vert);
+		std::vector<unsigned> indices_in, indices_out;
+		indices_in.reserve(max_count);
+		indices_out.reserve(max_count);
+		if (index_beg >= index_end)
+			return;
+
+		// #1 vertex shader
+		// post-transform vertices
+		std::vector<float> transformed;
+		constexpr unsigned unused = ~0u;
+		unsigned cache_size = m_vertex_cache_size;
+		unsigned hit = 0, miss = 0;
+		// without FIFO cache: vertex v is at transformed[slots[v - base]]
+		std::vector<unsigned> slots;
+		unsigned base = 0;
+		// with FIFO cache: cache line k holds vertex cache_tags[k]
+		std::vector<unsigned> cache_tags;
+		unsigned cache_next = 0;
+		if (!cache_size) {
+			// shade unique vertices of the range in one batch
+			auto range = std::minmax_element(ib.begin() + index_beg, ib.begin() + index_end);
+			base = *range.first;
+			slots.assign(*range.second - base + 1, unused);
+			std::vector<unsigned> unique;
+			for (auto i = index_beg; i < index_end; ++i)
+			{
+				auto &slot = slots[ib[i] - base];
+				if (slot != unused)
+					continue;
+				slot = unsigned(unique.size()) * output_stride;
+				unique.push_back(ib[i]);
+			}
+			transformed.resize(unique.size() * output_stride);
+			material->vertex_shader_batch(stream.attribs.data(), unsigned(attrib_count), vertex_stride,
+				unique.data(), unsigned(unique.size()), transformed.data(), output_stride);
+			miss = unsigned(unique.size());
+			hit = unsigned(index_end - index_beg) - miss;
+		}
+		else {
+			cache_tags.assign(cache_size, unused);
+			transformed.resize(cache_size * output_stride);
+		}
+		auto fetch_vertex = [&](unsigned v) -> const float* {
+			if (!cache_size)
+				return &transformed[slots[v - base]];
+			for (unsigned k = 0; k < cache_size; ++k)
+			{
+				if (cache_tags[k] == v) {
+					hit += 1;
+					return &transformed[k * output_stride];
+				}
+			}
+			miss += 1;
+			unsigned k = cache_next;
+			cache_next = (cache_next + 1) % cache_size;
+			cache_tags[k] = v;
+			float *out = &transformed[k * output_stride];
+			material->vertex_shader_batch(stream.attribs.data(), unsigned(attrib_count), vertex_stride, &v, 1, out, output_stride);
+			return out;
+		};
+
+		for (auto i = index_beg; i + 3 <= index_end; i += 3)
+		{
+			vertex_out.resize(output_stride * 3);
+			for (unsigned k = 0; k < 3; ++k)
+			{
+				const float *v = fetch_vertex(ib[i + k]);
+				std::copy(v, v + output_stride, &vertex_out[k * output_stride]);
+			}
+			indices_in.push_back(0);
+			indices_in.push_back(output_stride);
+			indices_in.push_back(output_stride * 2);
+			if (!cull_backface(vertex_out, output_stride)) {
+				// #2 geometry shader
+				material->geometry_shader(&vertex_out[0]);
+				if (inside_guard_band(&vertex_out[0], &vertex_out[output_stride], &vertex_out[output_stride * 2], m_guard_band)) {
+					GUARD_BAND_PASSED
+					indices_out.swap(indices_in);
+				}
+				else {
+					POLYGON_CLIPPED
+					clip_polygon_stream(vertex_out, indices_in, indices_out, output_stride);
+				}
+				if (indices_out.size() >= 3)
+				{
+					viewport_transform(vertex_out, indices_out);
+					handler(vertex_out, indices_out);
+				}
+			} // backface culling
+			indices_in.clear();
+			indices_out.clear();
+			vertex_out.clear();
+		} // end of for-loop
+		VERTEX_CACHE_HIT(hit)
+		VERTEX_CACHE_MISS(miss)
+	}
+
+	template<class PrimitiveHandler>
+	void CSpwPipeline::read_primitives(unsigned binner, PrimitiveHandler &&handler)
+	{
+		auto &cursor = m_prim_readers[binner];
+		unsigned binner_count = unsigned(m_prim_readers.size());
+		auto beg = cursor->begin();
+		auto end = cursor->end();
+		while (1) {
+			if (beg == end)
+			{
+				if (end > 0)
+					cursor->publish(end - 1);
+				end = cursor->wait_for(end);
+			}
+			const auto &prim = m_prim_queue.at(beg);
+			if (!prim.vertices) {
+				// EOF
+				cursor->publish(beg);
+				break;
+			}
+			if (beg % binner_count == binner)
+				handler(prim, beg);
+			++beg;
+		}
+	}
+
 } // namespace wyc
+
+#include "unitest.h"
+UNIT_TEST(primitive_queue)
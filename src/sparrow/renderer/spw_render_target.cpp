@@ -1,8 +1,40 @@
 #include "spw_render_target.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <emmintrin.h>
+#include <vector>
+#include "spw_tile.h"
+#include "pixel_format.h"
 
 namespace wyc
 {
+	// fill "count" words with a repeating pattern of 4 words, the aligned part is written by streaming stores
+	static void stream_fill(uint32_t *dst, const uint32_t *pattern, unsigned count)
+	{
+		unsigned i = 0;
+		for (; i < count && (uintptr_t(dst + i) & 15); ++i)
+			dst[i] = pattern[i & 3];
+		if (i + 4 <= count) {
+			__m128i v = _mm_setr_epi32(int(pattern[i & 3]), int(pattern[(i + 1) & 3]), int(pattern[(i + 2) & 3]), int(pattern[(i + 3) & 3]));
+			for (; i + 4 <= count; i += 4)
+				_mm_stream_si128((__m128i*)(dst + i), v);
+		}
+		for (; i < count; ++i)
+			dst[i] = pattern[i & 3];
+	}
+
+	// fill a row of swizzled surface of "pitch" width from pixel (x, y), x should be aligned to 4
+	static void stream_fill_swizzled(uint32_t *dst, unsigned pitch, unsigned x, unsigned y, const uint32_t *pattern, unsigned count)
+	{
+		assert((x & 3) == 0);
+		for (unsigned i = 0; i < count; i += 4)
+			stream_fill(dst + swizzle_index(x + i, y, pitch), pattern, std::min(4u, count - i));
+	}
+
 	CSpwRenderTarget::CSpwRenderTarget()
+		: m_color_format(SPW_INVALID_FORMAT)
+		, m_sample_count(1)
 	{
 	}
 
@@ -12,20 +44,19 @@ namespace wyc
 
 	bool CSpwRenderTarget::create(unsigned width, unsigned height, unsigned format)
 	{
-		m_color_buffer.release();
+		// a failed creation leaves an empty render target
+		release_surfaces();
 		unsigned frag_size = 0, alignment = 4;
 		EPixelFormat color_fmt = get_color_format(format);
-		switch (color_fmt)
-		{
-		case SPW_COLOR_R8G8B8A8:
-			frag_size = 4;
-			break;
-		case SPW_COLOR_RGBA_F32:
-			frag_size = 16;
-			break;
-		default:
+		frag_size = get_color_size(color_fmt);
+		if (!frag_size)
 			return false;
-		}
+		bool swizzled = is_swizzled_format(format);
+		if (swizzled && (frag_size != 4 || get_sample_count(format) > 1))
+			return false;
+		// swizzled surfaces are padded to 64x64 blocks
+		unsigned storage_w = swizzled ? align_up(width, 64) : width;
+		unsigned storage_h = swizzled ? align_up(height, 64) : height;
 		if (!m_color_buffer.storage(width, height, frag_size, alignment))
 			return false;
 		EPixelFormat depth_format = get_depth_format(format);
@@ -39,13 +70,10 @@ namespace wyc
 			frag_size = 0;
 			break;
 		}
-		if (frag_size)
+		if (frag_size && !m_depth_buffer.storage(storage_w, storage_h, frag_size, alignment))
 		{
-			if (!m_depth_buffer.storage(width, height, frag_size, alignment))
-			{
-				m_color_buffer.release();
-				return false;
-			}
+			release_surfaces();
+			return false;
 		}
 		EPixelFormat stencil_format = get_stencil_format(format);
 		switch (stencil_format)
@@ -60,18 +88,182 @@ namespace wyc
 			frag_size = 0;
 			break;
 		}
-		if (frag_size)
+		if (frag_size && !m_stencil_buffer.storage(width, height, frag_size, alignment))
+		{
+			release_surfaces();
+			return false;
+		}
+		unsigned sample_count = get_sample_count(format);
+		if (sample_count > 1)
 		{
-			if (!m_stencil_buffer.storage(width, height, frag_size, alignment))
+			if (!m_sample_color.storage(width * sample_count, height, m_color_buffer.fragment_size(), alignment)
+				|| (has_depth() && !m_sample_depth.storage(width * sample_count, height, m_depth_buffer.fragment_size(), alignment)))
 			{
-				m_color_buffer.release();
-				m_depth_buffer.release();
+				release_surfaces();
 				return false;
 			}
 		}
+		if (swizzled && !m_swizzle_color.storage(storage_w, storage_h, m_color_buffer.fragment_size(), alignment))
+		{
+			release_surfaces();
+			return false;
+		}
+		m_color_format = color_fmt;
+		m_sample_count = sample_count;
 		m_rt_width = width;
 		m_rt_height = height;
 		return true;
 	}
 
+	void CSpwRenderTarget::release_surfaces()
+	{
+		m_color_buffer.release();
+		m_depth_buffer.release();
+		m_stencil_buffer.release();
+		m_sample_color.release();
+		m_sample_depth.release();
+		m_swizzle_color.release();
+		m_color_format = SPW_INVALID_FORMAT;
+		m_sample_count = 1;
+		m_rt_width = 0;
+		m_rt_height = 0;
+	}
+
+	void CSpwRenderTarget::resolve()
+	{
+		if (m_sample_count != 4)
+			return;
+		if (m_color_buffer.fragment_size() == 16)
+		{
+			// 4 samples of RGBA_F32 are 4 registers
+			const __m128 quarter = _mm_set1_ps(0.25f);
+			for (unsigned y = 0; y < m_rt_height; ++y)
+			{
+				const float *src = (const float*)m_sample_color.get_line(y);
+				float *dst = (float*)m_color_buffer.get_line(y);
+				for (unsigned x = 0; x < m_rt_width; ++x, src += 16, dst += 4)
+				{
+					__m128 c = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(src), _mm_loadu_ps(src + 4)),
+						_mm_add_ps(_mm_loadu_ps(src + 8), _mm_loadu_ps(src + 12)));
+					_mm_storeu_ps(dst, _mm_mul_ps(c, quarter));
+				}
+			}
+		}
+		else if (m_color_format == SPW_COLOR_R8G8B8A8)
+		{
+			// 4 samples of R8G8B8A8 are 1 register, channels are summed in 16-bit
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i round = _mm_set1_epi16(2);
+			for (unsigned y = 0; y < m_rt_height; ++y)
+			{
+				const uint8_t *src = m_sample_color.get_line(y);
+				uint32_t *dst = (uint32_t*)m_color_buffer.get_line(y);
+				for (unsigned x = 0; x < m_rt_width; ++x, src += 16)
+				{
+					__m128i c = _mm_loadu_si128((const __m128i*)src);
+					__m128i sum = _mm_add_epi16(_mm_unpacklo_epi8(c, zero), _mm_unpackhi_epi8(c, zero));
+					sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+					sum = _mm_srli_epi16(_mm_add_epi16(sum, round), 2);
+					dst[x] = uint32_t(_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum)));
+				}
+			}
+		}
+		else
+		{
+			// sRGB and half float samples are averaged in linear float
+			std::vector<color4f> samples(m_rt_width * 4);
+			std::vector<color4f> pixels(m_rt_width);
+			for (unsigned y = 0; y < m_rt_height; ++y)
+			{
+				unpack_color(samples.data(), m_sample_color.get_line(y), m_rt_width * 4, m_color_format);
+				for (unsigned x = 0; x < m_rt_width; ++x)
+				{
+					const color4f *s = &samples[x * 4];
+					pixels[x] = (s[0] + s[1] + s[2] + s[3]) * 0.25f;
+				}
+				pack_color(m_color_buffer.get_line(y), pixels.data(), m_rt_width, m_color_format);
+			}
+		}
+	}
+
+	void CSpwRenderTarget::linearize()
+	{
+		if (m_swizzle_color.empty())
+			return;
+		uint32_t *dst = (uint32_t*)m_color_buffer.get_buffer();
+		const uint32_t *src = (const uint32_t*)m_swizzle_color.get_buffer();
+		assert((uintptr_t(src) & 15) == 0 && "swizzled color should be 16 bytes aligned");
+		unsigned dpitch = m_color_buffer.pitch() / sizeof(uint32_t);
+		unsigned sw = m_swizzle_color.row_length(), sh = m_swizzle_color.row();
+		// 4x4 tiles are converted by SIMD, and the margins by pixel
+		unsigned w4 = align_down(m_rt_width, 4), h4 = align_down(m_rt_height, 4);
+		linearize_32bpp_fast(dst, w4, h4, dpitch, src, sw);
+		if (w4 < m_rt_width)
+			linearize_32bpp(dst + w4, m_rt_width - w4, m_rt_height, dpitch, src, w4, 0, sw, sh);
+		if (h4 < m_rt_height)
+			linearize_32bpp(dst + h4 * dpitch, w4, m_rt_height - h4, dpitch, src, 0, h4, sw, sh);
+	}
+
+	void CSpwRenderTarget::present_rect(uint32_t *dst, unsigned dpitch, unsigned x, unsigned y, unsigned w, unsigned h) const
+	{
+		dst += y * dpitch + x;
+		if (m_swizzle_color.empty())
+		{
+			for (unsigned row = 0; row < h; ++row)
+				encode_srgb8(dst + row * dpitch, m_color_buffer.get(x, y + row), w, m_color_format);
+			return;
+		}
+		assert((x & 63) == 0 && (y & 63) == 0 && w <= 64 && h <= 64);
+		const uint32_t *src = (const uint32_t*)m_swizzle_color.get(0, 0);
+		unsigned sw = m_swizzle_color.row_length(), sh = m_swizzle_color.row();
+		// sRGB is linearized to image directly, others through a block in L1
+		alignas(16) uint32_t block[64 * 64];
+		bool is_srgb = m_color_format == SPW_COLOR_R8G8B8A8_SRGB;
+		uint32_t *out = is_srgb ? dst : block;
+		unsigned opitch = is_srgb ? dpitch : 64;
+		unsigned w4 = align_down(w, 4), h4 = align_down(h, 4);
+		if (w4 && h4)
+			linearize_32bpp_fast(out, w4, h4, opitch, src + swizzle_index(x, y, sw), sw);
+		if (w4 < w)
+			linearize_32bpp(out + w4, w - w4, h, opitch, src, x + w4, y, sw, sh);
+		if (h4 < h)
+			linearize_32bpp(out + h4 * opitch, w4, h - h4, opitch, src, x, y + h4, sw, sh);
+		if (!is_srgb)
+			for (unsigned row = 0; row < h; ++row)
+				encode_srgb8(dst + row * dpitch, block + row * 64, w, m_color_format);
+	}
+
+	void CSpwRenderTarget::clear_rect(unsigned x, unsigned y, unsigned w, unsigned h, const color4f &color, float depth, bool multisample)
+	{
+		unsigned sample_count = multisample ? m_sample_count : 1;
+		bool swizzled = !multisample && is_swizzled();
+		CSurface &color_surf = multisample ? m_sample_color : (swizzled ? m_swizzle_color : m_color_buffer);
+		CSurface &depth_surf = multisample ? m_sample_depth : m_depth_buffer;
+		// clear values repeated in 4 words, a pixel has 1, 2 or 4 words
+		uint32_t color_pattern[4], depth_pattern[4];
+		unsigned pixel_words = color_surf.fragment_size() / sizeof(uint32_t);
+		pack_color(color_pattern, &color, 1, m_color_format);
+		for (unsigned i = pixel_words; i < 4; ++i)
+			color_pattern[i] = color_pattern[i - pixel_words];
+		unsigned color_words = pixel_words * sample_count;
+		uint32_t depth_bits;
+		memcpy(&depth_bits, &depth, sizeof(float));
+		std::fill(depth_pattern, depth_pattern + 4, depth_bits);
+		for (unsigned row = y; row < y + h; ++row)
+		{
+			if (swizzled)
+				stream_fill_swizzled((uint32_t*)color_surf.get_buffer(), color_surf.row_length(), x, row, color_pattern, w);
+			else
+				stream_fill(color_surf.get<uint32_t>(x * sample_count, row), color_pattern, w * color_words);
+			if (depth_surf.empty())
+				continue;
+			if (swizzled)
+				stream_fill_swizzled((uint32_t*)depth_surf.get_buffer(), depth_surf.row_length(), x, row, depth_pattern, w);
+			else
+				stream_fill(depth_surf.get<uint32_t>(x * sample_count, row), depth_pattern, w * sample_count);
+		}
+		// streaming stores are weakly ordered
+		_mm_sfence();
+	}
+
 } // namespace wyc
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "render_target.h"
 #include "surface.h"
 #include "util.h"
+#include "vecmath.h"
 
 namespace wyc
 {
@@ -33,12 +34,60 @@ namespace wyc
 		{
 			return !m_stencil_buffer.empty();
 		}
+		// multi-sampled color and depth, they are created if format has SPW_MSAA_4X
+		// samples of pixel (x, y) are stored at [x * sample_count, (x + 1) * sample_count) of row y
+		// only the tile pipeline renders to samples, and resolve() averages them to color buffer
+		inline unsigned sample_count() const
+		{
+			return m_sample_count;
+		}
+		inline CSurface& get_sample_color_buffer()
+		{
+			return m_sample_color;
+		}
+		inline CSurface& get_sample_depth_buffer()
+		{
+			return m_sample_depth;
+		}
+		void resolve();
+		inline EPixelFormat color_format() const
+		{
+			return m_color_format;
+		}
+		// swizzled color is created if format has SPW_LAYOUT_SWIZZLE, pixel (x, y) is at swizzle_index(x, y, row_length)
+		// pipelines render to it, and linearize() converts it to color buffer for presentation
+		// depth buffer has the same layout, it's never presented so there's no linear copy
+		// swizzled layout is only supported by 32bpp color (RGBA8 or sRGB) without multi-sampling
+		inline bool is_swizzled() const
+		{
+			return !m_swizzle_color.empty();
+		}
+		inline CSurface& get_swizzled_color_buffer()
+		{
+			return m_swizzle_color;
+		}
+		void linearize();
+		// convert rectangle (x, y, w, h) of color to 8-bit sRGB pixels of "dst" image, "dpitch" is in pixels
+		// resolve() should be called before if it's multi-sampled
+		// swizzled color is linearized on the way without going through color buffer, (x, y) should be aligned to 64
+		void present_rect(uint32_t *dst, unsigned dpitch, unsigned x, unsigned y, unsigned w, unsigned h) const;
+		// fill color and depth of rectangle (x, y, w, h) with clear values, using non-temporal stores
+		// "multisample" clears the samples instead of pixels
+		void clear_rect(unsigned x, unsigned y, unsigned w, unsigned h, const color4f &color, float depth, bool multisample);
 
 	private:
 		DISALLOW_COPY_MOVE_AND_ASSIGN(CSpwRenderTarget)
 		CSurface m_color_buffer;
 		CSurface m_depth_buffer;
 		CSurface m_stencil_buffer;
+		CSurface m_sample_color;
+		CSurface m_sample_depth;
+		CSurface m_swizzle_color;
+		EPixelFormat m_color_format;
+		unsigned m_sample_count;
+
+		// release all surfaces and reset the format
+		void release_surfaces();
 	};
 
 } // namespace wyc
@@ -44,7 +44,9 @@ namespace wyc
 	{
 		if (!m_pipeline)
 		{
-			m_pipeline = std::make_shared<CSpwPipeline>();
+			auto pipeline = std::make_shared<CSpwPipeline>();
+			pipeline->setup();
+			set_pipeline(pipeline);
 		}
 		if (m_cmd_queue.batch_dequeue(m_cmd_buffer, m_cmd_buffer.capacity()))
 		{
@@ -1,14 +1,49 @@
 #include "tile.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <emmintrin.h>
+#include "spw_tile.h"
+#include "pixel_format.h"
+#include "metric.h"
 
 namespace wyc
 {
+	// copy 32-bit words with streaming stores, the flushed tile is not read again by this unit
+	// so it should not evict the working set from cache
+	static void stream_copy(uint32_t *dst, const uint32_t *src, unsigned count)
+	{
+		for (; count && (uintptr_t(dst) & 15); --count)
+			*dst++ = *src++;
+		for (; count >= 4; count -= 4, dst += 4, src += 4)
+			_mm_stream_si128((__m128i*)dst, _mm_loadu_si128((const __m128i*)src));
+		for (; count; --count)
+			*dst++ = *src++;
+	}
+
+	// copy a row of pixels to swizzled surface of "pitch" width, from pixel (x, y)
+	// pixels in a row of 4x4 tile are contiguous, so they are copied together
+	static void stream_copy_swizzled(uint32_t *dst, unsigned pitch, unsigned x, unsigned y, const uint32_t *src, unsigned count)
+	{
+		assert((x & 3) == 0);
+		for (unsigned i = 0; i < count; i += 4)
+			stream_copy(dst + swizzle_index(x + i, y, pitch), src + i, std::min(4u, count - i));
+	}
+
 	CTile::CTile(CSpwRenderTarget *rt, const box2i &b, const vec2i &c)
 		: bounding(b)
 		, center(c)
 		, m_rt(rt)
+		, m_buffer(nullptr)
+		, m_color(nullptr)
+		, m_depth(nullptr)
+		, m_origin(0, 0)
+		, m_pitch(0)
 		, m_material(nullptr)
 		, m_stride(0)
 		, m_correction(true)
+		, m_derivative(false)
 	{
 		m_transform_y = m_rt->height() - center.y - 1;
 	}
@@ -26,8 +61,8 @@ namespace wyc
 		m_ctx.vertex_quad = &m_frag_input[0];
 
 		auto feature = material->feature();
-		if (feature & MF_NO_PERSPECTIVE_CORRECTION)
-			m_correction = false;
+		m_correction = !(feature & MF_NO_PERSPECTIVE_CORRECTION);
+		m_derivative = (feature & MF_QUAD_DERIVATIVE) != 0;
 	}
 
 	void CTile::operator() (int x, int y) {
@@ -38,8 +73,7 @@ namespace wyc
 		out_color.g *= out_color.a;
 		out_color.b *= out_color.a;
 		y = m_rt->height() - y - 1;
-		auto &surf = m_rt->get_color_buffer();
-		surf.set(x, y, out_color);
+		m_color[_offset(x, y)] = out_color;
 	}
 
 	void CTile::operator() (int x, int y, float z, float w1, float w2, float w3) {
@@ -47,11 +81,10 @@ namespace wyc
 		//y = m_rt->height() - (y + center.y) - 1;
 		y = m_transform_y - y;
 		// z-test first
-		auto &depth = m_rt->get_depth_buffer();
-		auto d = *depth.get<float>(x, y);
-		if (z >= d)
+		int offset = _offset(x, y);
+		if (z >= m_depth[offset])
 			return;
-		depth.set(x, y, z);
+		m_depth[offset] = z;
 		// interpolate vertex attributes
 		const float *i0 = m_v0, *i1 = m_v1, *i2 = m_v2;
 		float z_world = 1 / (m_inv_z0 * w1 + m_inv_z1 * w2 + m_inv_z2 * w3);
@@ -71,54 +104,64 @@ namespace wyc
 		out_color.r *= out_color.a;
 		out_color.g *= out_color.a;
 		out_color.b *= out_color.a;
-		auto &surf = m_rt->get_color_buffer();
-		surf.set(x, y, out_color);
+		m_color[offset] = out_color;
 	}
 
 	void CTile::operator()(int x, int y, const vec4f & z, const vec4i &is_inside,
 		const vec4f & w1, const vec4f & w2, const vec4f & w3)
 	{
-		// interpolate vertex attributes
-		if(m_correction)
-			_interp_with_correction(w1, w2, w3);
-		else
-			_interp(w1, w2, w3);
-		// write frame buffer
 		x += center.x;
 		y = m_transform_y - y;
-		vec2i screen_pos[4] = {
-			{ x, y },{ x + 1, y },
-			{ x, y - 1 },{ x + 1, y - 1 },
+		int offset = _offset(x, y);
+		int quad_offset[4] = {
+			offset, offset + 1,
+			offset - m_pitch, offset - m_pitch + 1,
 		};
-		auto &depth = m_rt->get_depth_buffer();
-		auto &surf = m_rt->get_color_buffer();
+		// z-test first
+		unsigned live = 0;
 		for (int i = 0; i < 4; ++i) {
-			if (is_inside[i] >= 0) {
-				// is inside 
-				auto &pos = screen_pos[i];
-				auto d = *depth.get<float>(pos.x, pos.y);
-				if (z[i] >= d)
-					continue;
-				depth.set(pos.x, pos.y, z[i]);
-				// write render target
-				color4f out_color;
-				// #3 fragment shader
-				if (!m_material->fragment_shader(m_frag_interp[i], out_color, &m_ctx))
-					continue;
-				// write fragment buffer
-				out_color.r *= out_color.a;
-				out_color.g *= out_color.a;
-				out_color.b *= out_color.a;
-				surf.set(pos.x, pos.y, out_color);
-			}
+			if (is_inside[i] >= 0 && z[i] < m_depth[quad_offset[i]])
+				live |= 1 << i;
+		}
+		if (!live) {
+			INTERP_SKIPPED(4)
+			return;
+		}
+		// interpolate vertex attributes of live pixels
+		// ddx/ddy are taken from pixel 0, 1 and 2, so they are interpolated as well if the shader needs derivatives
+		unsigned interp_mask = m_derivative ? (live | 0x7) : live;
+		if (m_correction)
+			_interp_with_correction(interp_mask, w1, w2, w3);
+		else
+			_interp(interp_mask, w1, w2, w3);
+		// #3 fragment shader
+		color4f out_color[4];
+		unsigned written = m_material->fragment_shader_quad(m_frag_input.data(), m_stride, live, out_color, &m_ctx);
+		// write tile buffer
+		for (int i = 0; i < 4; ++i) {
+			if (!(live & (1 << i)))
+				continue;
+			m_depth[quad_offset[i]] = z[i];
+			if (!(written & (1 << i)))
+				continue;
+			// write fragment buffer
+			auto &c = out_color[i];
+			c.r *= c.a;
+			c.g *= c.a;
+			c.b *= c.a;
+			m_color[quad_offset[i]] = c;
 		}
 	}
 
-	void CTile::_interp(const vec4f & w1, const vec4f & w2, const vec4f & w3)
+	void CTile::_interp(unsigned mask, const vec4f & w1, const vec4f & w2, const vec4f & w3)
 	{
 		const float *i0 = m_v0, *i1 = m_v1, *i2 = m_v2;
-		float *out = &m_frag_input[0];
 		for (int j = 0; j < 4; ++j) {
+			if (!(mask & (1 << j))) {
+				INTERP_SKIPPED(1)
+				continue;
+			}
+			float *out = m_frag_interp[j];
 			for (unsigned i = 0; i < m_stride; ++i, ++out)
 			{
 				*out = i0[i] * w1[j] + i1[i] * w2[j] + i2[i] * w3[j];
@@ -126,14 +169,18 @@ namespace wyc
 		}
 	}
 
-	void CTile::_interp_with_correction(const vec4f & w1, const vec4f & w2, const vec4f & w3)
+	void CTile::_interp_with_correction(unsigned mask, const vec4f & w1, const vec4f & w2, const vec4f & w3)
 	{
 		vec4f z_world;
 		z_world = w1 * m_inv_z0 + w2 * m_inv_z1 + w3 * m_inv_z2;
 		z_world.invert();
 		const float *i0 = m_v0, *i1 = m_v1, *i2 = m_v2;
-		float *out = &m_frag_input[0];
 		for (int j = 0; j < 4; ++j) {
+			if (!(mask & (1 << j))) {
+				INTERP_SKIPPED(1)
+				continue;
+			}
+			float *out = m_frag_interp[j];
 			for (unsigned i = 0; i < m_stride; ++i, ++out)
 			{
 				*out = (i0[i] * m_inv_z0 * w1[j] + i1[i] * m_inv_z1 * w2[j] + i2[i] * m_inv_z2 * w3[j]) * z_world[j];
@@ -141,21 +188,130 @@ namespace wyc
 		}
 	}
 
-	void CTile::clear(const color4f &c)
+	size_t CTile::_bind(TileBuffer *buffer)
 	{
-		box2i b = bounding;
-		b.min += center;
-		b.max += center;
-		int h = m_rt->height();
-		//color4f bg(0, 0, 0, 1.f);
-		auto &surf = m_rt->get_color_buffer();
-		for (auto y = b.min.y; y < b.max.y; ++y) {
-			for (auto x = b.min.x; x < b.max.x; ++x) {
-				auto ty = h - y - 1;
-				//assert(bg == *surf.get<color4f>(x, ty));
-				surf.set(x, ty, c);
+		assert(buffer && !m_buffer);
+		int w = bounding.max.x - bounding.min.x;
+		int h = bounding.max.y - bounding.min.y;
+		// quads may cover one more column and row at the margin of odd size
+		int rows = (h + 1) & ~1;
+		m_pitch = (w + 1) & ~1;
+		size_t size = size_t(m_pitch) * rows;
+		if (buffer->color.size() < size) {
+			buffer->color.resize(size);
+			buffer->depth.resize(size);
+		}
+		if (buffer->packed.size() < size_t(w) * 2)
+			buffer->packed.resize(w * 2);
+		m_buffer = buffer;
+		m_color = buffer->color.data();
+		m_depth = buffer->depth.data();
+		m_origin.x = center.x + bounding.min.x;
+		m_origin.y = m_transform_y - (bounding.min.y + rows - 1);
+		return size;
+	}
+
+	void CTile::load(TileBuffer *buffer, const color4f &color, float depth)
+	{
+		size_t size = _bind(buffer);
+		std::fill(m_color, m_color + size, color);
+		// every fragment passes z-test if there's no depth buffer
+		std::fill(m_depth, m_depth + size, m_rt->has_depth() ? depth : std::numeric_limits<float>::max());
+	}
+
+	void CTile::load(TileBuffer *buffer)
+	{
+		size_t size = _bind(buffer);
+		int w = bounding.max.x - bounding.min.x;
+		bool swizzled = m_rt->is_swizzled();
+		auto &surf = swizzled ? m_rt->get_swizzled_color_buffer() : m_rt->get_color_buffer();
+		EPixelFormat format = m_rt->color_format();
+		unsigned swizzle_pitch = surf.row_length();
+		uint32_t *packed = buffer->packed.data();
+		for (int y = bounding.min.y; y < bounding.max.y; ++y) {
+			int row = m_transform_y - y;
+			color4f *dst = m_color + _offset(m_origin.x, row);
+			if (swizzled) {
+				// gather the row, swizzled format is 1 word per pixel
+				const uint32_t *src = (const uint32_t*)surf.get_buffer();
+				for (int x = 0; x < w; x += 4)
+					memcpy(packed + x, src + swizzle_index(m_origin.x + x, row, swizzle_pitch), std::min(4, w - x) * sizeof(uint32_t));
+				unpack_color(dst, packed, w, format);
+			}
+			else {
+				unpack_color(dst, surf.get(m_origin.x, row), w, format);
+			}
+		}
+		if (!m_rt->has_depth()) {
+			// every fragment passes z-test
+			std::fill(m_depth, m_depth + size, std::numeric_limits<float>::max());
+			return;
+		}
+		auto &depth = m_rt->get_depth_buffer();
+		for (int y = bounding.min.y; y < bounding.max.y; ++y) {
+			int row = m_transform_y - y;
+			float *dst = m_depth + _offset(m_origin.x, row);
+			if (swizzled) {
+				const float *src = (const float*)depth.get_buffer();
+				for (int x = 0; x < w; ++x)
+					dst[x] = src[swizzle_index(m_origin.x + x, row, swizzle_pitch)];
+			}
+			else {
+				memcpy(dst, depth.get<float>(m_origin.x, row), w * sizeof(float));
 			}
 		}
 	}
 
+	void CTile::store()
+	{
+		assert(m_buffer);
+		unsigned w = unsigned(bounding.max.x - bounding.min.x);
+		bool swizzled = m_rt->is_swizzled();
+		auto &surf = swizzled ? m_rt->get_swizzled_color_buffer() : m_rt->get_color_buffer();
+		EPixelFormat format = m_rt->color_format();
+		unsigned pixel_words = surf.fragment_size() / sizeof(uint32_t);
+		unsigned swizzle_pitch = surf.row_length();
+		uint32_t *packed = m_buffer->packed.data();
+		for (int y = bounding.min.y; y < bounding.max.y; ++y) {
+			int row = m_transform_y - y;
+			const color4f *src = m_color + _offset(m_origin.x, row);
+			if (format == SPW_COLOR_RGBA_F32) {
+				stream_copy(surf.get<uint32_t>(m_origin.x, row), (const uint32_t*)src, w * pixel_words);
+				continue;
+			}
+			// convert the row in cache, and stream it to render target
+			pack_color(packed, src, w, format);
+			if (swizzled)
+				stream_copy_swizzled((uint32_t*)surf.get_buffer(), swizzle_pitch, m_origin.x, row, packed, w);
+			else
+				stream_copy(surf.get<uint32_t>(m_origin.x, row), packed, w * pixel_words);
+		}
+		if (m_rt->has_depth()) {
+			auto &depth = m_rt->get_depth_buffer();
+			for (int y = bounding.min.y; y < bounding.max.y; ++y) {
+				int row = m_transform_y - y;
+				const uint32_t *src = (const uint32_t*)(m_depth + _offset(m_origin.x, row));
+				if (swizzled)
+					stream_copy_swizzled((uint32_t*)depth.get_buffer(), swizzle_pitch, m_origin.x, row, src, w);
+				else
+					stream_copy(depth.get<uint32_t>(m_origin.x, row), src, w);
+			}
+		}
+		// streaming stores are weakly ordered, make them visible before the tile is handed over
+		_mm_sfence();
+		m_buffer = nullptr;
+		m_color = nullptr;
+		m_depth = nullptr;
+	}
+
+	void CTile::clear(const color4f &color, float depth)
+	{
+		assert(!m_buffer);
+		unsigned w = unsigned(bounding.max.x - bounding.min.x);
+		unsigned h = unsigned(bounding.max.y - bounding.min.y);
+		// top row of the tile in render target
+		unsigned row = unsigned(m_transform_y - (bounding.max.y - 1));
+		m_rt->clear_rect(unsigned(center.x + bounding.min.x), row, w, h, color, depth, false);
+	}
+
 } // namespace wyc
@@ -7,6 +7,15 @@
 
 namespace wyc
 {
+	// tile-local color & depth of a fragment unit, reused by all the tiles it draws
+	struct TileBuffer
+	{
+		std::vector<color4f> color;
+		std::vector<float> depth;
+		// scan line in render target format, at most 2 words per pixel
+		std::vector<uint32_t> packed;
+	};
+
 	class CTile 
 	{
 	public:
@@ -25,8 +34,15 @@ namespace wyc
 			m_inv_z1 = 1 / v1[3];
 			m_inv_z2 = 1 / v2[3];
 		}
-		// clear the tile
-		void clear(const color4f &c);
+		// bind tile-local buffer and load color & depth of the tile from render target
+		// fragments are written to the buffer until store()
+		void load(TileBuffer *buffer);
+		// bind tile-local buffer and fill it with clear values, render target is not read
+		void load(TileBuffer *buffer, const color4f &color, float depth);
+		// flush tile-local buffer to render target with streaming stores
+		void store();
+		// clear color & depth of the tile in render target, with streaming stores
+		void clear(const color4f &color, float depth);
 		// plot mode
 		void operator() (int x, int y);
 		// fill mode
@@ -36,9 +52,22 @@ namespace wyc
 			const vec4f &w1, const vec4f &w2, const vec4f &w3);
 
 	private:
-		void _interp(const vec4f & w1, const vec4f & w2, const vec4f & w3);
-		void _interp_with_correction(const vec4f & w1, const vec4f & w2, const vec4f & w3);
+		// interpolate vertex attributes of the quad pixels in mask
+		void _interp(unsigned mask, const vec4f & w1, const vec4f & w2, const vec4f & w3);
+		void _interp_with_correction(unsigned mask, const vec4f & w1, const vec4f & w2, const vec4f & w3);
+		// bind tile-local buffer and return its size in pixels
+		size_t _bind(TileBuffer *buffer);
+		// offset of surface position (x, y) in tile-local buffer
+		inline int _offset(int x, int y) const {
+			return (y - m_origin.y) * m_pitch + x - m_origin.x;
+		}
 		CSpwRenderTarget *m_rt;
+		TileBuffer *m_buffer;
+		color4f *m_color;
+		float *m_depth;
+		// surface position of the first fragment in tile-local buffer
+		vec2i m_origin;
+		int m_pitch;
 		const CMaterial *m_material;
 		const float *m_v0, *m_v1, *m_v2;
 		float m_inv_z0, m_inv_z1, m_inv_z2;
@@ -48,6 +77,7 @@ namespace wyc
 		unsigned m_stride;
 		CShaderContext m_ctx;
 		bool m_correction;
+		bool m_derivative;
 	};
 
 } // namespace wyc
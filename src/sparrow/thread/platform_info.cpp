@@ -1,4 +1,5 @@
 #include "platform_info.h"
+#include <cstdint>
 #include <cstdlib>
 #include <cassert>
 #include <thread>
@@ -6,9 +7,16 @@
 #define WIN32_LEAN_AND_MEAN
 #define NOMINMAX
 #include <Windows.h>
-#else
+#include <intrin.h>
+#elif defined(__APPLE__)
 #include <sys/sysctl.h>
 #include <sys/types.h>
+#elif defined(__linux__)
+#include <sys/utsname.h>
+#include <unistd.h>
+#endif
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
 #endif
 
 #include "spw_config.h"
@@ -41,6 +49,66 @@ namespace wyc
 		return code == 0;
 	}
 #endif // __APPLE__
+
+	// cpuid leaf "func", sub-leaf "sub", into {eax, ebx, ecx, edx}
+	static bool get_cpuid(unsigned func, unsigned sub, unsigned regs[4])
+	{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		int info[4];
+		__cpuid(info, 0);
+		if (unsigned(info[0]) < func)
+			return false;
+		__cpuidex(info, int(func), int(sub));
+		for (int i = 0; i < 4; ++i)
+			regs[i] = unsigned(info[i]);
+		return true;
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+		if (__get_cpuid_max(0, nullptr) < func)
+			return false;
+		__cpuid_count(func, sub, regs[0], regs[1], regs[2], regs[3]);
+		return true;
+#else
+		(void)func;
+		(void)sub;
+		(void)regs;
+		return false;
+#endif
+	}
+
+	// register state enabled by OS (XCR0)
+	static uint64_t get_xcr0()
+	{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		return _xgetbv(0);
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+		unsigned eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return (uint64_t(edx) << 32) | eax;
+#else
+		return 0;
+#endif
+	}
+
+	static void detect_simd(PlatformInfo &info)
+	{
+		unsigned regs[4];
+		if (!get_cpuid(1, 0, regs))
+			return;
+		info.has_sse4_1 = (regs[2] & (1 << 19)) != 0;
+		// OSXSAVE and AVX
+		constexpr unsigned avx_bits = (1 << 27) | (1 << 28);
+		if ((regs[2] & avx_bits) != avx_bits)
+			return;
+		uint64_t xcr0 = get_xcr0();
+		// XMM and YMM state
+		if ((xcr0 & 0x06) != 0x06)
+			return;
+		if (!get_cpuid(7, 0, regs))
+			return;
+		info.has_avx2 = (regs[1] & (1 << 5)) != 0;
+		// AVX512F, plus opmask and ZMM state
+		info.has_avx512 = (regs[1] & (1 << 16)) != 0 && (xcr0 & 0xe6) == 0xe6;
+	}
 	
 	PlatformInfo::PlatformInfo()
 		: os("Unknown")
@@ -51,7 +119,11 @@ namespace wyc
 		, cache_size({64, 64, 64})
 		, memory(0)
 		, page_size(4 * 1024)
+		, has_sse4_1(false)
+		, has_avx2(false)
+		, has_avx512(false)
 	{
+		detect_simd(*this);
 #if defined(WIN32) || defined(WIN64)
 		SYSTEM_INFO si;
 		GetSystemInfo(&si);
@@ -127,6 +199,35 @@ namespace wyc
 			page_size = (size_t)val;
 		if(get_sys_var(CTL_HW, HW_MEMSIZE, val64))
 			memory = val64;
+#elif defined(__linux__)
+		struct utsname name;
+		if (uname(&name) == 0)
+		{
+			os = name.sysname;
+			os += " ";
+			os += name.release;
+			architecture = name.machine;
+		}
+		long val = sysconf(_SC_NPROCESSORS_ONLN);
+		if (val > 0)
+			ncpu = unsigned(val);
+		val = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+		if (val > 0)
+			cacheline = size_t(val);
+		// sysconf returns 0 if the cache level is unknown
+		const int cache_names[3] = { _SC_LEVEL1_DCACHE_SIZE, _SC_LEVEL2_CACHE_SIZE, _SC_LEVEL3_CACHE_SIZE };
+		for (int i = 0; i < 3; ++i)
+		{
+			val = sysconf(cache_names[i]);
+			if (val > 0)
+				cache_size[i] = size_t(val);
+		}
+		val = sysconf(_SC_PAGESIZE);
+		if (val > 0)
+			page_size = size_t(val);
+		long pages = sysconf(_SC_PHYS_PAGES);
+		if (pages > 0)
+			memory = size_t(pages) * page_size;
 #endif
 	}
 } // namespace wyc
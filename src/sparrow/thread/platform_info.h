@@ -22,6 +22,10 @@ namespace wyc
 		size_t memory;
 		// software page size
 		size_t page_size;
+		// SIMD instruction sets supported by both cpu and OS
+		bool has_sse4_1;
+		bool has_avx2;
+		bool has_avx512;
 	};
 
 	inline const PlatformInfo& get_platform_info() {
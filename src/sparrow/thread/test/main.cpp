@@ -6,6 +6,8 @@
 #include "ring_queue.h"
 #include "folly_queue.h"
 #include "disruptor.h"
+#include "thread_pool.h"
+#include "spw_pipeline.h"
 
 int main()
 {
@@ -15,6 +17,8 @@ int main()
 	//RUN_TEST(folly_queue);
 	//RUN_TEST(ring_queue);
 	RUN_TEST(disruptor_queue);
+	//RUN_TEST(primitive_queue);
+	//RUN_TEST(thread_pool);
 
 	::system("pause");
 }
\ No newline at end of file
@@ -0,0 +1,134 @@
+#include "spw_pipeline.h"
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+UNIT_TEST_BEG(primitive_queue)
+
+#include "common.h"
+
+using namespace wyc;
+
+constexpr unsigned PRODUCER_COUNT = 2;
+
+// drive the primitive queue of the pipeline without vertex and fragment stages
+class CPrimitiveQueueTester : public CSpwPipeline
+{
+public:
+	CPrimitiveQueueTester()
+	{
+		setup();
+		m_payload_pools.resize(PRODUCER_COUNT);
+	}
+
+	// each producer publishes "count" polygons of "vertex_count" vertices
+	// return false if binners don't receive them intact, "rate" is primitives per second
+	bool run(unsigned vertex_count, unsigned stride, int64_t count, double &rate)
+	{
+		// polygon vertices are interleaved with unused ones, like the output of clipper
+		std::vector<float> vertices(vertex_count * 2 * stride);
+		std::vector<unsigned> indices;
+		for (unsigned i = 0; i < vertices.size(); ++i)
+			vertices[i] = float(i);
+		for (unsigned i = 0; i < vertex_count; ++i)
+			indices.push_back(i * 2 * stride);
+		double expected = 0;
+		for (auto j : indices)
+			expected += vertices[j] + vertices[j + stride - 1];
+		size_t size = vertex_count * stride;
+		bool is_inline = size <= PRIMITIVE_PAYLOAD_SIZE;
+		for (auto &pool : m_payload_pools)
+			pool.reset();
+
+		auto t0 = std::chrono::high_resolution_clock::now();
+		std::vector<std::thread> threads;
+		for (unsigned p = 0; p < PRODUCER_COUNT; ++p)
+		{
+			CSpwBinPool *pool = &m_payload_pools[p];
+			threads.emplace_back([this, &vertices, &indices, stride, count, pool] {
+				for (int64_t i = 0; i < count; ++i)
+					publish_primitive(vertices, indices, stride, nullptr, pool);
+			});
+		}
+		unsigned binner_count = unsigned(m_prim_readers.size());
+		std::vector<double> sum(binner_count, 0);
+		std::vector<int64_t> taken(binner_count, 0);
+		std::vector<int64_t> broken(binner_count, 0);
+		std::vector<std::thread> binners;
+		for (unsigned k = 0; k < binner_count; ++k)
+		{
+			binners.emplace_back([this, k, vertex_count, stride, is_inline, &sum, &taken, &broken] {
+				read_primitives(k, [&](const Primitive &prim, int64_t seq) {
+					taken[k] += 1;
+					if (prim.count != vertex_count || prim.stride != stride || (prim.vertices == prim.payload) != is_inline) {
+						broken[k] += 1;
+						return;
+					}
+					const float *vec = prim.vertices;
+					for (unsigned i = 0; i < prim.count; ++i, vec += prim.stride)
+						sum[k] += vec[0] + vec[prim.stride - 1];
+				});
+			});
+		}
+		for (auto &t : threads)
+			t.join();
+		publish_eof();
+		for (auto &t : binners)
+			t.join();
+		auto t1 = std::chrono::high_resolution_clock::now();
+
+		int64_t total = PRODUCER_COUNT * count;
+		double total_sum = 0;
+		int64_t total_taken = 0, total_broken = 0;
+		for (unsigned k = 0; k < binner_count; ++k)
+		{
+			total_sum += sum[k];
+			total_taken += taken[k];
+			total_broken += broken[k];
+		}
+		if (total_taken != total || total_broken) {
+			std::cout << "FAILED: " << total_taken << " of " << total << " primitives are taken, " << total_broken << " are broken" << std::endl;
+			return false;
+		}
+		if (total_sum != expected * total) {
+			std::cout << "FAILED: vertices are corrupted" << std::endl;
+			return false;
+		}
+		// only the vertices which don't fit the inline payload go to the pools
+		for (auto &pool : m_payload_pools)
+		{
+			if (is_inline ? pool.used() != 0 : pool.used() < count * size * sizeof(float)) {
+				std::cout << "FAILED: payload pool has " << pool.used() << " bytes" << std::endl;
+				return false;
+			}
+		}
+		double seconds = std::chrono::duration<double>(t1 - t0).count();
+		rate = total / seconds;
+		return true;
+	}
+};
+
+void test()
+{
+	std::cout << "Test primitive queue..." << std::endl;
+	// overflowed vertices are kept in pools until reset, so the count is limited
+	constexpr int64_t COUNT = 1 << 15;
+	std::unique_ptr<CPrimitiveQueueTester> tester(new CPrimitiveQueueTester);
+	// clipped triangle with 16 floats per vertex fills the inline payload exactly
+	static_assert(MAX_POLYGON_VERTEX * 16 <= PRIMITIVE_PAYLOAD_SIZE, "clipped triangle should fit the inline payload");
+	double inline_rate;
+	if (!tester->run(MAX_POLYGON_VERTEX, 16, COUNT, inline_rate))
+		return;
+	// one more float per vertex doesn't fit, vertices are allocated from the payload pool of producer
+	static_assert(MAX_POLYGON_VERTEX * 17 > PRIMITIVE_PAYLOAD_SIZE, "polygon should overflow the inline payload");
+	double pool_rate;
+	if (!tester->run(MAX_POLYGON_VERTEX, 17, COUNT, pool_rate))
+		return;
+	std::cout << "Pass" << std::endl;
+	std::cout << "inline payload: " << inline_rate / 1000000 << " M primitives/s" << std::endl;
+	std::cout << "pool payload: " << pool_rate / 1000000 << " M primitives/s" << std::endl;
+	printf("test done!\n");
+}
+
+UNIT_TEST_END
@@ -0,0 +1,49 @@
+#include "thread_pool.h"
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <thread>
+
+UNIT_TEST_BEG(thread_pool)
+
+#include "common.h"
+
+void test()
+{
+	std::cout << "Test wyc thread pool..." << std::endl;
+
+	unsigned ncore = std::thread::hardware_concurrency();
+	wyc::CThreadPool pool(ncore > 0 ? ncore : 1);
+	
+	// parallel for
+	std::vector<unsigned long> data(N, 0);
+	auto t0 = std::chrono::high_resolution_clock::now();
+	pool.parallel_for(unsigned(N), [&data](unsigned i) {
+		data[i] = i;
+	});
+	auto t1 = std::chrono::high_resolution_clock::now();
+	for (unsigned long i = 0; i < N; ++i)
+	{
+		assert(data[i] == i);
+		busy(message(i, data[i]));
+	}
+
+	// submit jobs
+	std::atomic<unsigned long> sum(0);
+	std::vector<std::future<void>> jobs;
+	for (unsigned long i = 0; i < QUEUE_SIZE; ++i)
+	{
+		jobs.push_back(pool.submit([&sum, i] {
+			sum += i;
+		}));
+	}
+	for (auto &h : jobs)
+		h.get();
+	assert(sum == QUEUE_SIZE * (QUEUE_SIZE - 1) / 2);
+
+	auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0);
+	std::cout << "Pass: retuls=0x" << std::hex << std::uppercase << g_result.m_sum << std::dec << std::endl;
+	std::cout << "Stat: ms/op=" << float(duration.count()) / N << std::endl;
+}
+
+UNIT_TEST_END
@@ -0,0 +1,88 @@
+#include "thread_pool.h"
+#include <atomic>
+#if defined(WIN32) || defined(WIN64)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace wyc
+{
+	static void pin_thread(std::thread &t, unsigned core)
+	{
+#if defined(WIN32) || defined(WIN64)
+		SetThreadAffinityMask(t.native_handle(), DWORD_PTR(1) << core);
+#elif defined(__linux__)
+		cpu_set_t cpuset;
+		CPU_ZERO(&cpuset);
+		CPU_SET(core, &cpuset);
+		pthread_setaffinity_np(t.native_handle(), sizeof(cpu_set_t), &cpuset);
+#else
+		// thread affinity is not supported (e.g. macOS), leave it to the scheduler
+		(void)t;
+		(void)core;
+#endif
+	}
+
+	CThreadPool::CThreadPool(unsigned count, bool pin_core)
+		: m_stop(false)
+	{
+		unsigned ncore = std::thread::hardware_concurrency();
+		m_workers.reserve(count);
+		for (unsigned i = 0; i < count; ++i)
+		{
+			m_workers.emplace_back(&CThreadPool::worker_main, this);
+			if (pin_core && ncore > 0)
+				pin_thread(m_workers.back(), i % ncore);
+		}
+	}
+
+	CThreadPool::~CThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> guard(m_mutex);
+			m_stop = true;
+		}
+		m_cond.notify_all();
+		for (auto &t : m_workers)
+			t.join();
+	}
+
+	void CThreadPool::worker_main()
+	{
+		while (1) {
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_cond.wait(lock, [this] {
+					return m_stop || !m_jobs.empty();
+				});
+				if (m_jobs.empty())
+					// stopped and drained
+					return;
+				job = std::move(m_jobs.front());
+				m_jobs.pop_front();
+			}
+			job();
+		}
+	}
+
+	void CThreadPool::parallel_for(unsigned count, const std::function<void(unsigned)> &job)
+	{
+		std::atomic_uint next(0);
+		auto runner = [&next, count, &job] {
+			for (unsigned i = next++; i < count; i = next++)
+				job(i);
+		};
+		std::vector<std::future<void>> helpers;
+		for (unsigned i = 1, n = std::min(count, size() + 1); i < n; ++i)
+			helpers.push_back(submit(runner));
+		runner();
+		for (auto &h : helpers)
+			h.get();
+	}
+
+} // namespace wyc
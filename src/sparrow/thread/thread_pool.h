@@ -0,0 +1,62 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace wyc
+{
+	// persistent worker threads
+	// jobs are run in FIFO order, a job which blocks on other jobs (e.g. producer/consumer pairs)
+	// requires enough workers to run all of them at the same time
+	class CThreadPool
+	{
+	public:
+		// create "count" workers, worker i is pinned to core i if "pin_core" is set
+		CThreadPool(unsigned count, bool pin_core = true);
+		~CThreadPool();
+		CThreadPool(const CThreadPool&) = delete;
+		CThreadPool& operator = (const CThreadPool&) = delete;
+
+		unsigned size() const {
+			return unsigned(m_workers.size());
+		}
+
+		// queue a job and return its future
+		template<class Job>
+		std::future<void> submit(Job &&job);
+
+		// run job(i) for i in [0, count) and wait for them
+		// the calling thread takes part in the work
+		void parallel_for(unsigned count, const std::function<void(unsigned)> &job);
+
+	private:
+		void worker_main();
+
+		std::vector<std::thread> m_workers;
+		std::deque<std::function<void()>> m_jobs;
+		std::mutex m_mutex;
+		std::condition_variable m_cond;
+		bool m_stop;
+	};
+
+	template<class Job>
+	std::future<void> CThreadPool::submit(Job &&job)
+	{
+		auto task = std::make_shared<std::packaged_task<void()>>(std::forward<Job>(job));
+		auto ret = task->get_future();
+		{
+			std::lock_guard<std::mutex> guard(m_mutex);
+			m_jobs.emplace_back([task] {
+				(*task)();
+			});
+		}
+		m_cond.notify_one();
+		return ret;
+	}
+
+} // namespace wyc
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cassert>
+#include <mutex>
+#include <vector>
+#include "spin_lock.h"
+
+namespace wyc
+{
+	// bounded double-ended queue for work stealing
+	// owner thread pushes and pops at the bottom, other threads steal from the top
+	// the critical sections are a few instructions long, so a spin lock is used
+	template<class T>
+	class CWorkStealingQueue
+	{
+	public:
+		CWorkStealingQueue()
+		: m_top(0)
+		, m_bottom(0)
+		{
+		}
+
+		// drop all tasks and make room for at least "capacity" tasks
+		void reset(size_t capacity)
+		{
+			std::lock_guard<CSpinLock> guard(m_lock);
+			if (m_tasks.size() < capacity)
+				m_tasks.resize(capacity);
+			m_top = 0;
+			m_bottom = 0;
+		}
+
+		bool push(const T &task)
+		{
+			std::lock_guard<CSpinLock> guard(m_lock);
+			if (m_bottom >= m_tasks.size())
+				return false;
+			m_tasks[m_bottom++] = task;
+			return true;
+		}
+
+		bool pop(T &task)
+		{
+			std::lock_guard<CSpinLock> guard(m_lock);
+			if (m_top == m_bottom)
+				return false;
+			task = m_tasks[--m_bottom];
+			return true;
+		}
+
+		bool steal(T &task)
+		{
+			std::lock_guard<CSpinLock> guard(m_lock);
+			if (m_top == m_bottom)
+				return false;
+			task = m_tasks[m_top++];
+			return true;
+		}
+
+		size_t size() const
+		{
+			return m_bottom - m_top;
+		}
+
+	private:
+		std::vector<T> m_tasks;
+		size_t m_top;
+		size_t m_bottom;
+		CSpinLock m_lock;
+	};
+
+} // namespace wyc
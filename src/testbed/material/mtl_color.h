@@ -1,4 +1,5 @@
 #pragma once
+#include <algorithm>
 #include "ImathMatrix.h"
 #include "material.h"
 
@@ -52,6 +53,18 @@ public:
 		return true;
 	}
 
+	virtual unsigned fragment_shader_quad(const float *frag_in, unsigned stride, unsigned mask, wyc::color4f *frag_color, wyc::CShaderContext *ctx) const override
+	{
+		std::fill(frag_color, frag_color + 4, color);
+		return mask;
+	}
+
+	virtual unsigned fragment_shader_tile(const float *frag_in, unsigned stride, unsigned mask, wyc::color4f *frag_color, wyc::CShaderContext *ctx) const override
+	{
+		std::fill(frag_color, frag_color + 16, color);
+		return mask;
+	}
+
 protected:
 	wyc::mat4f proj_from_world;
 	wyc::color4f color;
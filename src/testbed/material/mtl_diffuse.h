@@ -66,6 +66,25 @@ public:
 		return true;
 	}
 
+	virtual unsigned fragment_shader_quad(const float *frag_in, unsigned stride, unsigned mask, wyc::color4f *frag_color, wyc::CShaderContext *ctx) const override
+	{
+		// the quad is sampled at once, pixels out of mask take uv of a live pixel
+		unsigned live = 0;
+		while (!(mask & (1 << live)))
+			++live;
+		wyc::vec2f uv[4];
+		for (unsigned i = 0; i < 4; ++i)
+			uv[i] = reinterpret_cast<const VertexOut*>(frag_in + ((mask & (1 << i)) ? i : live) * stride)->uv;
+		wyc::color4f diffuse_color[4];
+		diffuse->sample2d_quad(uv, diffuse_color);
+		for (unsigned i = 0; i < 4; ++i)
+		{
+			if (mask & (1 << i))
+				frag_color[i] = diffuse_color[i] * reinterpret_cast<const VertexOut*>(frag_in + i * stride)->color;
+		}
+		return mask;
+	}
+
 protected:
 	wyc::mat4f proj_from_world;
 	wyc::CSampler *diffuse;
@@ -48,7 +48,7 @@ public:
 			len = half;
 		}
 
-		m_feature |= wyc::MF_NO_PERSPECTIVE_CORRECTION;
+		m_feature |= wyc::MF_NO_PERSPECTIVE_CORRECTION | wyc::MF_QUAD_DERIVATIVE;
 	}
 
 	struct VertexIn {
@@ -1,5 +1,6 @@
 #include "test.h"
 #include "image.h"
+#include "spw_pipeline2.h"
 
 bool CTest::init(const boost::program_options::variables_map &args) {
 	if (args.count("out")) {
@@ -9,8 +10,8 @@ bool CTest::init(const boost::program_options::variables_map &args) {
 		m_params = args["param"].as<std::vector<std::string>>();
 	}
 	auto max_core = args["core"].as<unsigned>();
-	m_image_w = std::min<int>(2048, args["width"].as<unsigned>());
-	m_image_h = std::min<int>(2048, args["height"].as<unsigned>());
+	m_image_w = std::min<int>(SPW_MAX_TARGET_SIZE, args["width"].as<unsigned>());
+	m_image_h = std::min<int>(SPW_MAX_TARGET_SIZE, args["height"].as<unsigned>());
 	return setup_renderer(m_image_w, m_image_h, max_core);
 }
 
@@ -38,11 +39,46 @@ bool CTest::setup_renderer(unsigned img_w, unsigned img_h, unsigned max_core)
 	m_renderer = std::make_shared<wyc::CSpwRenderer>();
 	// create render target
 	auto render_target = std::make_shared<wyc::CSpwRenderTarget>();
-	render_target->create(img_w, img_h, wyc::SPW_COLOR_RGBA_F32 | wyc::SPW_DEPTH_32);
+	unsigned format = wyc::SPW_COLOR_RGBA_F32 | wyc::SPW_DEPTH_32;
+	// packed color format: rgba8, srgb8 or rgba16f
+	std::string color_format;
+	if (get_param("color_format", color_format)) {
+		if (color_format == "rgba8")
+			format = wyc::SPW_COLOR_R8G8B8A8 | wyc::SPW_DEPTH_32;
+		else if (color_format == "srgb8")
+			format = wyc::SPW_COLOR_R8G8B8A8_SRGB | wyc::SPW_DEPTH_32;
+		else if (color_format == "rgba16f")
+			format = wyc::SPW_COLOR_RGBA_F16 | wyc::SPW_DEPTH_32;
+	}
+	// 4x multi-sampling, it's rendered by tile pipeline only
+	std::string msaa;
+	if (get_param("msaa", msaa))
+		format |= wyc::SPW_MSAA_4X;
+	// swizzled 32bpp color and depth, it's linearized at present
+	std::string swizzle;
+	if (get_param("swizzle", swizzle)) {
+		unsigned color = format & wyc::SPW_COLOR_MASK;
+		if (color != wyc::SPW_COLOR_R8G8B8A8_SRGB)
+			color = wyc::SPW_COLOR_R8G8B8A8;
+		format = color | wyc::SPW_DEPTH_32 | wyc::SPW_LAYOUT_SWIZZLE;
+	}
+	render_target->create(img_w, img_h, format);
 	m_renderer->set_render_target(render_target);
 	// create pipeline
-	auto pipeline = std::make_shared<wyc::CSpwPipeline>();
+	std::shared_ptr<wyc::CSpwPipeline> pipeline;
+	std::string pipeline_type;
+	if (get_param("pipeline", pipeline_type) && pipeline_type == "tile")
+		pipeline = std::make_shared<wyc::CSpwTilePipeline>();
+	else
+		pipeline = std::make_shared<wyc::CSpwPipeline>();
 	pipeline->setup(max_core);
+	// rasterize all draws of a frame at present
+	std::string deferred;
+	pipeline->set_deferred(get_param("deferred", deferred));
+	// stream vertices through a FIFO post-transform cache
+	std::string vertex_cache;
+	if (get_param("vertex_cache", vertex_cache) && !vertex_cache.empty())
+		pipeline->set_vertex_cache(std::stoul(vertex_cache));
 	m_renderer->set_pipeline(pipeline);
 	// create LDR image buffer
 	m_ldr_image.storage(img_w, img_h, 4);
@@ -73,23 +109,8 @@ const void * CTest::get_color_buf(unsigned & width, unsigned & height, unsigned
 	width = buffer.row_length();
 	height = buffer.row();
 	assert(m_ldr_image.row_length() == width && m_ldr_image.row() == height);
-	// NOTICE: we assume that render target is 4-bytes RGBA format
 	pitch_in_pixel = m_ldr_image.pitch() / 4;
-	// linear space to sRGB space
-	constexpr float gamma = 1 / 2.2f;
-	for (unsigned y = 0; y < height; ++y) {
-		auto iter = (const wyc::color4f*)buffer.get_line(y);
-		auto end = iter + width;
-		auto out = (uint32_t*)m_ldr_image.get_line(y);
-		for (; iter != end; ++iter) {
-			wyc::color4f c = {
-				std::pow(iter->r, gamma),
-				std::pow(iter->g, gamma),
-				std::pow(iter->b, gamma),
-				iter->a
-			};
-			*out++ = Imath::rgb2packed(c);
-		}
-	}
+	// deferred draws are rasterized, and linear color is converted to 8-bit sRGB by pipeline workers
+	m_renderer->get_pipeline()->present((uint32_t*)m_ldr_image.get_buffer(), pitch_in_pixel);
 	return m_ldr_image.get_buffer();
 }
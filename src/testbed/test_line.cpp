@@ -35,6 +35,8 @@ public:
 	{
 		// clear frame buffer
 		m_renderer->process();
+		// clear is deferred, apply it before writing to render target directly
+		m_renderer->get_pipeline()->resolve();
 
 		// direct write to render target
 		auto render_target = std::dynamic_pointer_cast<wyc::CSpwRenderTarget>(m_renderer->get_render_target());
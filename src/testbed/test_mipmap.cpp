@@ -62,50 +62,32 @@ bool generate_mipmap(const std::string &image_file)
 
 class CMaterialDiffuseMipmap : public CMaterialDiffuse
 {
-	UNIFORM_MAP{
-		UNIFORM_SLOT(wyc::mat4f, proj_from_world)
-		UNIFORM_SLOT(wyc::CSampler*, diffuse)
-		UNIFORM_SLOT(unsigned, texture_size)
-		UNIFORM_MAP_END
-	};
-
 public:
 	CMaterialDiffuseMipmap()
 		: CMaterialDiffuse()
-		, texture_size(0)
 	{
+		m_feature |= wyc::MF_QUAD_DERIVATIVE;
 	}
 
-	virtual bool fragment_shader(const void *frag_in, wyc::color4f &frag_color, wyc::CShaderContext *ctx) const override
+	virtual unsigned fragment_shader_quad(const float *frag_in, unsigned stride, unsigned mask, wyc::color4f *frag_color, wyc::CShaderContext *ctx) const override
 	{
-		auto in = reinterpret_cast<const VertexOut*>(frag_in);
-		wyc::color4f diffuse_color;
-		auto duvdx = ctx->ddx(&VertexOut::uv);
-		auto duvdy = ctx->ddy(&VertexOut::uv);
-		float r1 = std::sqrtf(duvdx ^ duvdx);
-		float r2 = std::sqrtf(duvdy ^ duvdy);
-		union {
-			float f;
-			unsigned i;
-		} j;
-		j.f = std::max(r1, r2) * texture_size;
-		int e = (j.i & 0x7f800000) >> 23;
-		if (e > 127) {
-			e -= 127;
-			int m = j.i & 0x7fffff;
-			float f = float(m) / (1 << 23);
-			wyc::color4f c1, c2;
-			diffuse->sample2d(in->uv, e, c1);
-			diffuse->sample2d(in->uv, e-1, c2);
-			diffuse_color = c1 * f + c2 * (1 - f);
+		// pixel 0, 1 and 2 are always interpolated for derivatives, pixel 3 takes uv of a live pixel if it's out of mask
+		unsigned live = 0;
+		while (!(mask & (1 << live)))
+			++live;
+		wyc::vec2f uv[4];
+		for (unsigned i = 0; i < 4; ++i)
+			uv[i] = reinterpret_cast<const VertexOut*>(frag_in + ((i < 3 || (mask & (1 << i))) ? i : live) * stride)->uv;
+		// sampler selects mip level of the quad
+		wyc::color4f diffuse_color[4];
+		diffuse->sample2d_grad(uv, ctx->ddx(&VertexOut::uv), ctx->ddy(&VertexOut::uv), diffuse_color);
+		for (unsigned i = 0; i < 4; ++i)
+		{
+			if (mask & (1 << i))
+				frag_color[i] = diffuse_color[i] * reinterpret_cast<const VertexOut*>(frag_in + i * stride)->color;
 		}
-		else
-			diffuse->sample2d(in->uv, diffuse_color);
-		frag_color = diffuse_color * in->color;
-		return true;
+		return mask;
 	}
-protected:
-	unsigned texture_size;
 };
 
 class CTestMipmap : public CTest
@@ -137,13 +119,17 @@ public:
 		diffuse_img->load("res/checkerboard.png");
 		//diffuse_img->create_checkerboard(64, {1, 1, 1}, {0, 0, 0});
 		std::vector<decltype(diffuse_img)> mipmap_images = { diffuse_img };
-		if (!diffuse_img->generate_mipmap(mipmap_images)) {
+		auto thread_pool = m_renderer->get_pipeline()->get_thread_pool();
+		if (!diffuse_img->generate_mipmap(mipmap_images, thread_pool.get())) {
 			log_error("create mipmap error");
 			return;
 		}
 		auto sampler = std::make_shared<wyc::CSpwMipmapSampler>(mipmap_images);
+		// anisotropic filtering with at most "anisotropy" probes
+		std::string anisotropy;
+		if (get_param("anisotropy", anisotropy) && !anisotropy.empty())
+			sampler->set_max_anisotropy(std::stoul(anisotropy));
 		mtl->set_uniform("diffuse", (wyc::CSampler*)sampler.get());
-		mtl->set_uniform("texture_size", diffuse_img->width());
 
 		// draw 
 		auto draw = m_renderer->new_command<wyc::cmd_draw_mesh>();
@@ -57,6 +57,10 @@ public:
 			}
 		}
 		log_info("rasterizer type: %d", m_type);
+		// force SIMD kernel of the Larrabee rasterizer: avx512, avx2, sse4 or scalar
+		if(get_param("kernel", param) && !set_tile_coverage_kernel(param.c_str())) {
+			log_warning("coverage kernel %s is not supported", param.c_str());
+		}
 		m_mesh = std::make_shared<wyc::CMesh>();
 		if (!m_mesh->load_ply(ply_file)) {
 			return false;
@@ -170,35 +174,6 @@ public:
 		} // triangle_coung
 	}
 
-	void scan_partial_queue(const Triangle *prim, BlockArena *arena, TileQueue *queue, TileQueue *full_tiles, TileQueue *partial_tiles) {
-		TileQueue output;
-		while(queue->head) {
-			TileBlock *t = queue->pop();
-			scan_tile(prim, t, arena, full_tiles, &output);
-			arena->free(t);
-			if(output.head) {
-				if(output.head->lod < SPW_LOD_MAX)
-					scan_partial_queue(prim, arena, &output, full_tiles, partial_tiles);
-				else
-					partial_tiles->join(&output);
-			}
-		}
-	}
-	
-	void scan_full_queue(const Triangle *prim, BlockArena *arena, TileQueue *queue, PixelShader shader)
-	{
-		while(queue->head) {
-			TileBlock *t = queue->pop();
-			if(t->lod < SPW_LOD_MAX) {
-				split_tile(prim, arena, t, queue);
-			}
-			else {
-				fill_tile(prim, t, shader);
-			}
-			arena->free(t);
-		}
-	}
-	
 	void draw_triangle_larrabee(unsigned triangle_count, const vec3i *indices, const std::vector<vec4f> &vertices)
 	{
 		BlockArena arena(256);
@@ -208,15 +183,22 @@ public:
 		rt.storage = (char*)m_ldr_image.get_buffer();
 		rt.pixel_size = m_ldr_image.fragment_size();
 		rt.pitch = m_ldr_image.pitch();
-		rt.w = m_ldr_image.row_length();
-		rt.h = m_ldr_image.row();
+		// render target size in blocks
+		rt.w = (m_ldr_image.row_length() + SPW_BLOCK_SIZE - 1) >> SPW_BLOCK_SIZE_BITS;
+		rt.h = (m_ldr_image.row() + SPW_BLOCK_SIZE - 1) >> SPW_BLOCK_SIZE_BITS;
 		rt.x = 0;
 		rt.y = 0;
 		
-		auto shader = [](char *dst, const vec3f &w) {
-			COUNT_PIXEL
-			*((unsigned*)dst) = 0xFF00FF00;
+		auto shader = [](void *ctx, char *dst, const TileCoverage &coverage) {
+			unsigned *pixels = (unsigned*)dst;
+			for(int i = 0; i < 16; ++i) {
+				if(coverage.mask & (1 << i)) {
+					COUNT_PIXEL
+					pixels[i] = 0xFF00FF00;
+				}
+			}
 		};
+		log_info("coverage kernel: %s", tile_coverage_kernel());
 
 		for(unsigned i = 0; i < triangle_count; i += 1)
 		{
@@ -240,15 +222,17 @@ public:
 				TIME_DRAW_TRIANGLE
 				Triangle prim;
 				setup_triangle(&prim, (const vec2f*)pos, (const vec2f*)(pos+1), (const vec2f*)(pos+2));
-				TileQueue partial_blocks, full_tiles, partial_tiles;
-				auto block_count = scan_block(&rt, &prim, &arena, &full_tiles, &partial_blocks);
+				TileQueue partial_blocks, full_blocks;
+				auto block_count = scan_block(&rt, &prim, &arena, &full_blocks, &partial_blocks);
 				if (block_count > max_block_count)
 					max_block_count = block_count;
-				scan_partial_queue(&prim, &arena, &partial_blocks, &full_tiles, &partial_tiles);
-				scan_full_queue(&prim, &arena, &full_tiles, shader);
-				for(auto it = partial_tiles.head; it; it = it->_next)
+				for(auto it = partial_blocks.head; it; it = it->_next)
+				{
+					rasterize_block(&prim, it, false, shader, nullptr);
+				}
+				for(auto it = full_blocks.head; it; it = it->_next)
 				{
-					draw_tile(&prim, it, shader);
+					rasterize_block(&prim, it, true, shader, nullptr);
 				}
 				if(arena.bucket_count() > max_bucket_count) {
 					max_bucket_count = arena.bucket_count();